@@ -0,0 +1,203 @@
+#include <dlfcn.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lisp.h"
+
+// programs compiled to C with lisp_emit_c() against the interpreter, in
+// ns per row: a formula over columns (lisp_eval_batch() against
+// <name>_batch()), the same formula and one calling defuns row by row
+// (lisp_eval_params() against <name>_eval()) and a recursive defun.
+// every result is checked. the programs go into one C file, built with
+// $CC (or cc) as a shared object and loaded with dlopen(). random
+// programs are checked the same way by tests/aot.c
+//
+// usage: aot [rows]
+
+typedef int EvalFn(const int* params, int num_params, int* out);
+typedef int BatchFn(const int* const* cols, int num_rows, int* out);
+
+#define FORMULA "(+ (* $0 $0) (if (> $1 $2) (- $1 $2) (% $2 7)))"
+#define DEFUNS "(define k 7) " \
+	"(defun g (x y) (let ((s (+ x y)) (d (- x y))) (if (> s d) (* s k) (% d 5)))) " \
+	"(+ (g $0 $1) (g $1 $2))"
+#define FIB "(defun f (n) (if (< n 2) n (+ (f (- n 1)) (f (- n 2))))) (f $0)"
+
+double now_seconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+unsigned next_rand(unsigned* seed) {
+	*seed = *seed * 1103515245 + 12345;
+	return *seed >> 16;
+}
+
+lisp_prog* compile(lisp_ctx* ctx, const char* src) {
+	lisp_prog* prog = lisp_compile(ctx, src, strlen(src));
+	if (prog == NULL) {
+		fprintf(stderr, "%s: %s\n", src, lisp_error(ctx));
+		exit(1);
+	}
+	return prog;
+}
+
+void emit(lisp_ctx* ctx, const char* src, const char* name, FILE* f) {
+	lisp_prog* prog = compile(ctx, src);
+	if (lisp_emit_c(ctx, prog, name, f) != 0) {
+		fprintf(stderr, "%s: %s\n", src, lisp_error(ctx));
+		exit(1);
+	}
+	lisp_prog_free(prog);
+}
+
+void* load(void* lib, const char* name) {
+	void* sym = dlsym(lib, name);
+	if (sym == NULL) {
+		fprintf(stderr, "%s\n", dlerror());
+		exit(1);
+	}
+	return sym;
+}
+
+void check(const char* name, int* out, int* expected, int num_rows) {
+	for (int i = 0; i < num_rows; i++) {
+		if (out[i] != expected[i]) {
+			fprintf(stderr, "%s: row %d is %d, expected %d\n", name, i, out[i], expected[i]);
+			exit(1);
+		}
+	}
+}
+
+// lisp_eval_params() and the compiled <name>_eval() on every row
+void run_rows(lisp_ctx* ctx, void* lib, const char* src, const char* name, int** cols, int num_rows, int* out, int* expected) {
+	lisp_prog* prog = compile(ctx, src);
+	char sym[64];
+	snprintf(sym, sizeof(sym), "%s_eval", name);
+	EvalFn* fn = load(lib, sym);
+
+	double start = now_seconds();
+	for (int r = 0; r < num_rows; r++) {
+		int params[3] = {cols[0][r], cols[1][r], cols[2][r]};
+		Value v;
+		if (lisp_eval_params(ctx, prog, params, 3, &v) != 0) {
+			fprintf(stderr, "%s: %s\n", src, lisp_error(ctx));
+			exit(1);
+		}
+		expected[r] = v.int_value;
+	}
+	double interp = now_seconds() - start;
+
+	start = now_seconds();
+	for (int r = 0; r < num_rows; r++) {
+		int params[3] = {cols[0][r], cols[1][r], cols[2][r]};
+		fn(params, 3, &out[r]);
+	}
+	double native = now_seconds() - start;
+
+	check(name, out, expected, num_rows);
+	printf("%-16s %12.2f %12.2f %10.1fx\n", name,
+		interp / num_rows * 1e9,
+		native / num_rows * 1e9,
+		interp / native);
+	lisp_prog_free(prog);
+}
+
+int main(int argc, char** argv) {
+	int num_rows = argc > 1 ? atoi(argv[1]) : 1 << 20;
+
+	int* cols[3];
+	for (int i = 0; i < 3; i++) {
+		cols[i] = malloc(sizeof(int) * num_rows);
+	}
+	int* expected = malloc(sizeof(int) * num_rows);
+	int* out = malloc(sizeof(int) * num_rows);
+
+	unsigned seed = 1;
+	for (int r = 0; r < num_rows; r++) {
+		for (int i = 0; i < 3; i++) {
+			cols[i][r] = (int)(next_rand(&seed) % 2001) - 1000;
+		}
+	}
+
+	// everything into one file, built once
+	char c_path[64], so_path[64], cmd[256];
+	snprintf(c_path, sizeof(c_path), "/tmp/lisp-aot-%d.c", (int)getpid());
+	snprintf(so_path, sizeof(so_path), "/tmp/lisp-aot-%d.so", (int)getpid());
+
+	lisp_ctx* ctx = lisp_ctx_new();
+	FILE* f = fopen(c_path, "w");
+	emit(ctx, FORMULA, "formula", f);
+	emit(ctx, DEFUNS, "defuns", f);
+	emit(ctx, FIB, "fib", f);
+	fclose(f);
+
+	const char* cc = getenv("CC") != NULL ? getenv("CC") : "cc";
+	snprintf(cmd, sizeof(cmd), "%s -std=gnu11 -O3 -fwrapv -fPIC -shared %s -o %s", cc, c_path, so_path);
+	double start = now_seconds();
+	if (system(cmd) != 0) {
+		fprintf(stderr, "%s failed\n", cmd);
+		return 1;
+	}
+	printf("built with %s in %.2f s\n", cc, now_seconds() - start);
+
+	void* lib = dlopen(so_path, RTLD_NOW);
+	if (lib == NULL) {
+		fprintf(stderr, "%s\n", dlerror());
+		return 1;
+	}
+	remove(c_path);
+	remove(so_path);
+
+	printf("%-16s %12s %12s %11s\n", "", "interp ns", "native ns", "speedup");
+
+	// by columns, against the interpreter's own columnar evaluation
+	lisp_prog* prog = compile(ctx, FORMULA);
+	BatchFn* batch = load(lib, "formula_batch");
+	start = now_seconds();
+	if (lisp_eval_batch(ctx, prog, (const int* const*)cols, 3, num_rows, expected) != 0) {
+		fprintf(stderr, "%s\n", lisp_error(ctx));
+		return 1;
+	}
+	double interp = now_seconds() - start;
+	start = now_seconds();
+	if (batch((const int* const*)cols, num_rows, out) != 0) {
+		fprintf(stderr, "formula_batch failed\n");
+		return 1;
+	}
+	double native = now_seconds() - start;
+	check("formula_batch", out, expected, num_rows);
+	printf("%-16s %12.2f %12.2f %10.1fx\n", "formula batch",
+		interp / num_rows * 1e9,
+		native / num_rows * 1e9,
+		interp / native);
+	lisp_prog_free(prog);
+
+	run_rows(ctx, lib, FORMULA, "formula", cols, num_rows, out, expected);
+	run_rows(ctx, lib, DEFUNS, "defuns", cols, num_rows, out, expected);
+
+	// fib(20..23) on a few rows
+	int fib_rows = 64;
+	int* fib_cols[3];
+	for (int i = 0; i < 3; i++) {
+		fib_cols[i] = malloc(sizeof(int) * fib_rows);
+		for (int r = 0; r < fib_rows; r++) {
+			fib_cols[i][r] = 20 + r % 4;
+		}
+	}
+	run_rows(ctx, lib, FIB, "fib", fib_cols, fib_rows, out, expected);
+
+	dlclose(lib);
+	lisp_ctx_free(ctx);
+	for (int i = 0; i < 3; i++) {
+		free(cols[i]);
+		free(fib_cols[i]);
+	}
+	free(expected);
+	free(out);
+	return 0;
+}
@@ -0,0 +1,132 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "lisp.h"
+
+// one formula over many rows of inputs, in ns per row: building and
+// compiling a source string for each row, compiling once and binding
+// $0.. for each row with lisp_eval_params(), and lisp_eval_batch() on the
+// columns, for a formula it can evaluate by columns and for the same
+// formula written with let, which it has to evaluate row by row. every
+// result is checked against the formula computed in C
+//
+// usage: batch [rows]
+
+#define FORMULA "(+ (* $0 $0) (if (> $1 $2) (- $1 $2) (% $2 7)))"
+#define FORMULA_LET "(let ((a $0) (b $1) (c $2)) (+ (* a a) (if (> b c) (- b c) (% c 7))))"
+#define FORMULA_FMT "(+ (* %d %d) (if (> %d %d) (- %d %d) (%% %d 7)))"
+
+double now_seconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int formula(int a, int b, int c) {
+	return a * a + (b > c ? b - c : c % 7);
+}
+
+void check(const char* name, int* out, int* expected, int num_rows) {
+	for (int i = 0; i < num_rows; i++) {
+		if (out[i] != expected[i]) {
+			fprintf(stderr, "%s: row %d is %d, expected %d\n", name, i, out[i], expected[i]);
+			exit(1);
+		}
+	}
+}
+
+lisp_prog* compile(lisp_ctx* ctx, const char* src) {
+	lisp_prog* prog = lisp_compile(ctx, src, strlen(src));
+	if (prog == NULL) {
+		fprintf(stderr, "%s\n", lisp_error(ctx));
+		exit(1);
+	}
+	return prog;
+}
+
+void run_batch(lisp_ctx* ctx, const char* name, const char* src, const int* const* cols, int num_rows, int* out) {
+	lisp_prog* prog = compile(ctx, src);
+	double start = now_seconds();
+	if (lisp_eval_batch(ctx, prog, cols, 3, num_rows, out) != 0) {
+		fprintf(stderr, "%s\n", lisp_error(ctx));
+		exit(1);
+	}
+	printf("%-16s %10.2f ns/row\n", name, (now_seconds() - start) / num_rows * 1e9);
+	lisp_prog_free(prog);
+}
+
+int main(int argc, char** argv) {
+	int num_rows = argc > 1 ? atoi(argv[1]) : 1 << 22;
+
+	int* cols[3];
+	for (int i = 0; i < 3; i++) {
+		cols[i] = malloc(sizeof(int) * num_rows);
+	}
+	int* expected = malloc(sizeof(int) * num_rows);
+	int* out = malloc(sizeof(int) * num_rows);
+
+	unsigned seed = 1;
+	for (int r = 0; r < num_rows; r++) {
+		for (int i = 0; i < 3; i++) {
+			seed = seed * 1103515245 + 12345;
+			cols[i][r] = (int)(seed >> 16) % 2000 - 1000;
+		}
+		expected[r] = formula(cols[0][r], cols[1][r], cols[2][r]);
+	}
+
+	lisp_ctx* ctx = lisp_ctx_new();
+	printf("%d rows of %s\n", num_rows, FORMULA);
+
+	// the slowest by far, so only over the first rows
+	int source_rows = num_rows < (1 << 16) ? num_rows : (1 << 16);
+	double start = now_seconds();
+	for (int r = 0; r < source_rows; r++) {
+		char src[256];
+		snprintf(src, sizeof(src), FORMULA_FMT,
+			cols[0][r], cols[0][r],
+			cols[1][r], cols[2][r],
+			cols[1][r], cols[2][r],
+			cols[2][r]);
+		lisp_prog* prog = compile(ctx, src);
+		Value v;
+		if (lisp_eval(ctx, prog, &v) != 0) {
+			fprintf(stderr, "%s\n", lisp_error(ctx));
+			return 1;
+		}
+		out[r] = v.int_value;
+		lisp_prog_free(prog);
+	}
+	printf("%-16s %10.2f ns/row\n", "source per row", (now_seconds() - start) / source_rows * 1e9);
+	check("source per row", out, expected, source_rows);
+
+	lisp_prog* prog = compile(ctx, FORMULA);
+	start = now_seconds();
+	for (int r = 0; r < num_rows; r++) {
+		int params[3] = {cols[0][r], cols[1][r], cols[2][r]};
+		Value v;
+		if (lisp_eval_params(ctx, prog, params, 3, &v) != 0) {
+			fprintf(stderr, "%s\n", lisp_error(ctx));
+			return 1;
+		}
+		out[r] = v.int_value;
+	}
+	printf("%-16s %10.2f ns/row\n", "params per row", (now_seconds() - start) / num_rows * 1e9);
+	check("params per row", out, expected, num_rows);
+	lisp_prog_free(prog);
+
+	run_batch(ctx, "batch, rows", FORMULA_LET, (const int* const*)cols, num_rows, out);
+	check("batch, rows", out, expected, num_rows);
+
+	run_batch(ctx, "batch, columns", FORMULA, (const int* const*)cols, num_rows, out);
+	check("batch, columns", out, expected, num_rows);
+
+	lisp_ctx_free(ctx);
+	for (int i = 0; i < 3; i++) {
+		free(cols[i]);
+	}
+	free(expected);
+	free(out);
+	return 0;
+}
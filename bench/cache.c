@@ -0,0 +1,100 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "lisp.h"
+
+// lisp_eval_source() on repetitive traffic, with and without the result
+// cache: requests are drawn from a pool of distinct programs, most of
+// them from the first few, and every other request spells its program
+// with different whitespace and variable names so it only matches by
+// its compiled Exprs. every result is checked against the uncached one
+//
+// usage: cache [requests] [distinct programs] [cache entries]
+
+double now_seconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+unsigned next_rand(unsigned* seed) {
+	*seed = *seed * 1103515245 + 12345;
+	return *seed >> 16;
+}
+
+// program i in one of two spellings
+void make_program(char* buf, size_t size, int i, int spelling) {
+	const char* fmt = spelling == 0
+		? "(let ((n %d) (k %d)) (sum (map sq (filter odd (range k (+ k n))))))"
+		: "(let ( (count %d)  (start %d) )\n\t(sum (map sq (filter odd (range start (+ start count))))))";
+	snprintf(buf, size, fmt, 1000 + i % 97 * 10, i);
+}
+
+int run(int num_requests, int num_programs, int cache_entries, int* results) {
+	lisp_ctx* ctx = lisp_ctx_new();
+	lisp_set_cache(ctx, cache_entries, 0);
+
+	unsigned seed = 1;
+	double start = now_seconds();
+	for (int r = 0; r < num_requests; r++) {
+		// 90% of the traffic goes to the first tenth of the programs
+		unsigned x = next_rand(&seed);
+		int i = x % 10 < 9
+			? next_rand(&seed) % (num_programs / 10 + 1)
+			: next_rand(&seed) % num_programs;
+
+		char src[256];
+		make_program(src, sizeof(src), i, r & 1);
+
+		Value v;
+		if (lisp_eval_source(ctx, src, strlen(src), &v) != 0) {
+			fprintf(stderr, "%s\n", lisp_error(ctx));
+			return 1;
+		}
+		if (results[r] == -1) {
+			results[r] = v.int_value;
+		} else if (results[r] != v.int_value) {
+			fprintf(stderr, "request %d: %d, expected %d\n", r, v.int_value, results[r]);
+			return 1;
+		}
+	}
+	double elapsed = now_seconds() - start;
+
+	lisp_cache_stats s = lisp_get_cache_stats(ctx);
+	printf("%-10d %10.2f %10lu %10lu %10lu %10lu %10zu\n",
+		cache_entries,
+		elapsed / num_requests * 1e6,
+		s.source_hits,
+		s.expr_hits,
+		s.misses,
+		s.evictions,
+		s.bytes);
+
+	lisp_ctx_free(ctx);
+	return 0;
+}
+
+int main(int argc, char** argv) {
+	int num_requests = argc > 1 ? atoi(argv[1]) : 200000;
+	int num_programs = argc > 2 ? atoi(argv[2]) : 1000;
+	int cache_entries = argc > 3 ? atoi(argv[3]) : 256;
+
+	int* results = malloc(sizeof(int) * num_requests);
+	memset(results, -1, sizeof(int) * num_requests);
+
+	printf("%-10s %10s %10s %10s %10s %10s %10s\n",
+		"entries", "us/req", "src hits", "expr hits", "misses", "evictions", "bytes");
+
+	// the first run fills in the results the others are checked against
+	if (run(num_requests, num_programs, 0, results) != 0
+	|| run(num_requests, num_programs, cache_entries / 4, results) != 0
+	|| run(num_requests, num_programs, cache_entries, results) != 0
+	|| run(num_requests, num_programs, num_programs * 2, results) != 0) {
+		return 1;
+	}
+
+	free(results);
+	return 0;
+}
@@ -0,0 +1,93 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "lisp.h"
+
+// throughput of the embedded interpreter: each thread owns a context and
+// evaluates the same expression in a loop, either compiling it once up
+// front or compiling it for every evaluation
+//
+// usage: embed [threads] [iterations per thread] [expr]
+
+typedef struct {
+	const char* src;
+	int iterations;
+	bool recompile;
+	long checksum;
+} Job;
+
+double now_seconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void* run_job(void* arg) {
+	Job* job = arg;
+	lisp_ctx* ctx = lisp_ctx_new();
+	size_t len = strlen(job->src);
+
+	lisp_prog* prog = job->recompile ? NULL : lisp_compile(ctx, job->src, len);
+
+	for (int i = 0; i < job->iterations; i++) {
+		if (job->recompile) {
+			prog = lisp_compile(ctx, job->src, len);
+		}
+
+		Value v;
+		if (prog == NULL || lisp_eval(ctx, prog, &v) != 0) {
+			fprintf(stderr, "%s\n", lisp_error(ctx));
+			exit(1);
+		}
+		job->checksum += v.int_value;
+
+		if (job->recompile) {
+			lisp_prog_free(prog);
+		}
+	}
+
+	if (!job->recompile) {
+		lisp_prog_free(prog);
+	}
+	lisp_ctx_free(ctx);
+	return NULL;
+}
+
+void run(int num_threads, int iterations, const char* src, bool recompile) {
+	pthread_t* threads = malloc(sizeof(pthread_t) * num_threads);
+	Job* jobs = calloc(num_threads, sizeof(Job));
+
+	double start = now_seconds();
+	for (int i = 0; i < num_threads; i++) {
+		jobs[i] = (Job){.src = src, .iterations = iterations, .recompile = recompile};
+		pthread_create(&threads[i], NULL, run_job, &jobs[i]);
+	}
+	for (int i = 0; i < num_threads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	double elapsed = now_seconds() - start;
+
+	long total = (long)num_threads * iterations;
+	printf("%-16s threads=%d evals=%ld time=%.3fs rate=%.0f evals/s\n",
+		recompile ? "compile+eval" : "eval only",
+		num_threads,
+		total,
+		elapsed,
+		total / elapsed);
+
+	free(jobs);
+	free(threads);
+}
+
+int main(int argc, char** argv) {
+	int num_threads = argc > 1 ? atoi(argv[1]) : 4;
+	int iterations = argc > 2 ? atoi(argv[2]) : 200000;
+	const char* src = argc > 3 ? argv[3] : "(+ (* 3 (sum (list 1 2 3 4))) (if (< 2 5) 7 9))";
+
+	run(num_threads, iterations, src, true);
+	run(num_threads, iterations, src, false);
+	return 0;
+}
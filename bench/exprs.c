@@ -0,0 +1,94 @@
+#include <malloc.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "lisp.h"
+
+// size and evaluation speed of compiled programs as they outgrow the
+// caches: a balanced tree of + - * with `2^depth` leaves, compiled once
+// and evaluated until about 2^24 nodes have been visited. bytes per node
+// is everything lisp_compile() kept allocated (glibc's malloc counters),
+// including the copy of the source
+//
+// usage: exprs [max_depth]
+
+double now_seconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+unsigned next_rand(unsigned* seed) {
+	*seed = *seed * 1103515245 + 12345;
+	return *seed >> 16;
+}
+
+void gen_tree(char** p, int depth, unsigned* seed) {
+	static const char* ops[] = {"+", "-", "*"};
+
+	if (depth == 0) {
+		*p += sprintf(*p, "%u", next_rand(seed) % 10);
+		return;
+	}
+
+	*p += sprintf(*p, "(%s ", ops[next_rand(seed) % 3]);
+	gen_tree(p, depth - 1, seed);
+	*(*p)++ = ' ';
+	gen_tree(p, depth - 1, seed);
+	*(*p)++ = ')';
+}
+
+size_t malloc_bytes() {
+	struct mallinfo2 mi = mallinfo2();
+	return mi.uordblks + mi.hblkhd;
+}
+
+int main(int argc, char** argv) {
+	int max_depth = argc > 1 ? atoi(argv[1]) : 20;
+
+	lisp_ctx* ctx = lisp_ctx_new();
+	printf("%10s %12s %12s\n", "nodes", "bytes/node", "ns/node");
+
+	for (int depth = 4; depth <= max_depth; depth += 4) {
+		char* src = malloc((size_t)16 << depth);
+		char* p = src;
+		unsigned seed = 1;
+		gen_tree(&p, depth, &seed);
+
+		size_t before = malloc_bytes();
+		lisp_prog* prog = lisp_compile(ctx, src, p - src);
+		size_t bytes = malloc_bytes() - before;
+		if (prog == NULL) {
+			fprintf(stderr, "%s\n", lisp_error(ctx));
+			return 1;
+		}
+
+		long num_nodes = (2L << depth) - 1;
+		int evals = (1 << 24) / num_nodes;
+		if (evals < 3) {
+			evals = 3;
+		}
+
+		Value v;
+		lisp_eval(ctx, prog, &v);
+
+		double start = now_seconds();
+		for (int i = 0; i < evals; i++) {
+			lisp_eval(ctx, prog, &v);
+		}
+		double elapsed = now_seconds() - start;
+
+		printf("%10ld %12.1f %12.2f\n",
+			num_nodes,
+			(double)bytes / num_nodes,
+			elapsed / evals / num_nodes * 1e9);
+
+		lisp_prog_free(prog);
+		free(src);
+	}
+
+	lisp_ctx_free(ctx);
+	return 0;
+}
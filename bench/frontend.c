@@ -0,0 +1,130 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lisp.h"
+
+// lisp_compile() throughput on one long file of top level forms at 1, 2,
+// 4 .. threads, split into the phases it traces: the paren prescan,
+// tokenize and make_ast (in parallel from 2 threads on) and parse (always
+// on one thread). every program is evaluated and checked against the
+// result at 1 thread
+//
+// usage: frontend [megabytes] [max threads]
+
+double now_seconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+unsigned next_rand(unsigned* seed) {
+	*seed = *seed * 1103515245 + 12345;
+	return *seed >> 16;
+}
+
+// about size bytes of forms, with a few names reused throughout
+char* gen_program(size_t size, size_t* out_len) {
+	static const char* forms[] = {
+		"(define v%u (+ (sq %u) (len (list 1 2 3 4 5 6 7 8))))\n",
+		"(defun f%u (n)\n\t(if (< n 2) 1 (+ (f%u (- n 1)) (f%u (- n 2)))))\n",
+		"(sum (map sq (filter odd (range 0 (%% %u 10)))))  ",
+		"(let ((a_long_variable_name 1) (b 2))\r\n  (* a_long_variable_name (+ b %u)))\n",
+	};
+
+	char* src = malloc(size + 256);
+	size_t len = 0;
+	unsigned seed = 1;
+	for (unsigned i = 0; len < size; i++) {
+		unsigned k = next_rand(&seed);
+		len += sprintf(src + len, forms[k % 4], i % 16, i % 16, i % 16);
+	}
+	len += sprintf(src + len, "(+ v1 v2)\n");
+	*out_len = len;
+	return src;
+}
+
+// the time of each traced phase in ms, from the folded trace
+void phase_times(lisp_ctx* ctx, double* prescan, double* make_ast, double* parse) {
+	char* buf;
+	size_t size;
+	FILE* f = open_memstream(&buf, &size);
+	lisp_write_trace(ctx, f, LISP_TRACE_FOLDED);
+	fclose(f);
+
+	*prescan = *make_ast = *parse = 0;
+	char name[64];
+	unsigned long ns;
+	int n;
+	for (char* p = buf; sscanf(p, "%63s %lu\n%n", name, &ns, &n) == 2; p += n) {
+		double ms = ns / 1e6;
+		if (!strcmp(name, "prescan")) {
+			*prescan += ms;
+		} else if (!strcmp(name, "parse")) {
+			*parse += ms;
+		} else {
+			*make_ast += ms;
+		}
+	}
+	free(buf);
+}
+
+int main(int argc, char** argv) {
+	int megabytes = argc > 1 ? atoi(argv[1]) : 64;
+	int max_threads = argc > 2 ? atoi(argv[2]) : sysconf(_SC_NPROCESSORS_ONLN);
+
+	size_t len;
+	char* src = gen_program((size_t)megabytes << 20, &len);
+	printf("%.1f MB of source, up to %d threads\n", len / 1e6, max_threads);
+	printf("%8s %10s %10s %10s %10s %10s\n",
+		"threads", "prescan", "make_ast", "parse", "MB/s", "front MB/s");
+
+	int expected = 0;
+	for (int t = 1; t <= max_threads; t *= 2) {
+		lisp_ctx* ctx = lisp_ctx_new();
+		lisp_set_threads(ctx, t, 1 << 16);
+		lisp_set_trace(ctx, 64);
+
+		double start = now_seconds();
+		lisp_prog* prog = lisp_compile(ctx, src, len);
+		double elapsed = now_seconds() - start;
+
+		if (prog == NULL) {
+			fprintf(stderr, "%s\n", lisp_error(ctx));
+			return 1;
+		}
+
+		// tokenize and make_ast, with the prescan that splits them up
+		double prescan, make_ast, parse;
+		phase_times(ctx, &prescan, &make_ast, &parse);
+		lisp_set_trace(ctx, 0);
+
+		Value v;
+		if (lisp_eval(ctx, prog, &v) != 0) {
+			fprintf(stderr, "%s\n", lisp_error(ctx));
+			return 1;
+		}
+		if (t == 1) {
+			expected = v.int_value;
+		} else if (v.int_value != expected) {
+			fprintf(stderr, "%d threads: %d, expected %d\n", t, v.int_value, expected);
+			return 1;
+		}
+
+		printf("%8d %8.1fms %8.1fms %8.1fms %10.1f %10.1f\n",
+			t,
+			prescan,
+			make_ast,
+			parse,
+			len / 1e6 / elapsed,
+			len / 1e6 / ((prescan + make_ast) / 1e3));
+
+		lisp_prog_free(prog);
+		lisp_ctx_free(ctx);
+	}
+
+	free(src);
+	return 0;
+}
@@ -0,0 +1,142 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// load generator for `lisp --serve`: each client connection sends
+// requests in batches of `depth` pipelined lines, waits for all of the
+// responses and records the latency of every request
+//
+// usage: loadgen socket_path [clients] [requests per client] [depth] [expr]
+
+typedef struct {
+	const char* socket_path;
+	const char* expr;
+	int requests;
+	int depth;
+	uint64_t* latencies; // requests entries
+	int errors;
+} Client;
+
+uint64_t now_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void* run_client(void* arg) {
+	Client* c = arg;
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	struct sockaddr_un addr = {.sun_family = AF_UNIX};
+	strncpy(addr.sun_path, c->socket_path, sizeof(addr.sun_path) - 1);
+	if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+		perror("loadgen: connect");
+		exit(1);
+	}
+
+	size_t line_len = strlen(c->expr) + 1;
+	char* batch = malloc(line_len * c->depth);
+	for (int i = 0; i < c->depth; i++) {
+		memcpy(batch + i * line_len, c->expr, line_len - 1);
+		batch[i * line_len + line_len - 1] = '\n';
+	}
+
+	char buf[65536];
+	for (int done = 0; done < c->requests; ) {
+		int n = c->depth < c->requests - done ? c->depth : c->requests - done;
+
+		uint64_t start = now_ns();
+		if (write(fd, batch, line_len * n) != (ssize_t)(line_len * n)) {
+			perror("loadgen: write");
+			exit(1);
+		}
+
+		// every newline completes the next request in order
+		int answered = 0;
+		bool line_start = true;
+		while (answered < n) {
+			ssize_t got = read(fd, buf, sizeof(buf));
+			if (got <= 0) {
+				fprintf(stderr, "loadgen: server closed the connection\n");
+				exit(1);
+			}
+			uint64_t now = now_ns();
+			for (ssize_t i = 0; i < got; i++) {
+				if (line_start && buf[i] == 'r') {
+					c->errors++; // "runtime error: ..."
+				}
+				line_start = buf[i] == '\n';
+				if (line_start) {
+					c->latencies[done + answered++] = now - start;
+				}
+			}
+		}
+		done += n;
+	}
+
+	free(batch);
+	close(fd);
+	return NULL;
+}
+
+int cmp_u64(const void* a, const void* b) {
+	uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+	return (x > y) - (x < y);
+}
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		fprintf(stderr, "usage: loadgen socket_path [clients] [requests] [depth] [expr]\n");
+		return 1;
+	}
+
+	int num_clients = argc > 2 ? atoi(argv[2]) : 8;
+	int requests = argc > 3 ? atoi(argv[3]) : 100000;
+	int depth = argc > 4 ? atoi(argv[4]) : 16;
+	const char* expr = argc > 5 ? argv[5] : "(+ (* 3 (sum (range 0 10))) (if (< 2 5) 7 9))";
+
+	Client* clients = calloc(num_clients, sizeof(Client));
+	pthread_t* threads = malloc(sizeof(pthread_t) * num_clients);
+	uint64_t* latencies = malloc(sizeof(uint64_t) * num_clients * requests);
+
+	uint64_t start = now_ns();
+	for (int i = 0; i < num_clients; i++) {
+		clients[i] = (Client){
+			.socket_path = argv[1],
+			.expr = expr,
+			.requests = requests,
+			.depth = depth,
+			.latencies = latencies + (size_t)i * requests
+		};
+		pthread_create(&threads[i], NULL, run_client, &clients[i]);
+	}
+
+	int errors = 0;
+	for (int i = 0; i < num_clients; i++) {
+		pthread_join(threads[i], NULL);
+		errors += clients[i].errors;
+	}
+	double elapsed = (now_ns() - start) / 1e9;
+
+	size_t total = (size_t)num_clients * requests;
+	qsort(latencies, total, sizeof(uint64_t), cmp_u64);
+
+	printf("clients=%d depth=%d requests=%zu errors=%d time=%.3fs\n",
+		num_clients, depth, total, errors, elapsed);
+	printf("rate %.0f req/s, p50 %.1f us, p99 %.1f us\n",
+		total / elapsed,
+		latencies[total / 2] / 1e3,
+		latencies[total * 99 / 100] / 1e3);
+
+	free(latencies);
+	free(threads);
+	free(clients);
+	return 0;
+}
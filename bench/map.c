@@ -0,0 +1,173 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// map_put() is internal, so this benchmark builds lisp.c into itself
+#include "../lisp.c"
+
+// key-value lookups in the language at 1k to 10M entries: a map built
+// with put and read with get, against a list of keys scanned with nth,
+// which is what there was before maps. every lookup result is checked.
+// the gets read a map built beforehand, handed to the program by a
+// builtin added with lisp_add_builtin(), so that they are timed on their
+// own. then the latency of single puts while a map grows to the largest
+// size, against what rehashing its whole index at once would have cost
+//
+// usage: map [max entries]
+
+double bench_seconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#define BUILD \
+	"(defun build (i n m) (if (= i n) m (build (+ i 1) n (put (* i 7) i m)))) "
+
+// the key of lookup j, (j * step) % n of the keys put, for a step that
+// spreads the lookups over all of them
+#define KEY "(* (%% (* j %d) %d) 7)"
+
+// seconds to evaluate src, checking that it gives expected
+double run(lisp_ctx* ctx, const char* src, int expected) {
+	lisp_prog* prog = lisp_compile(ctx, src, strlen(src));
+	if (prog == NULL) {
+		fprintf(stderr, "%s\n", lisp_error(ctx));
+		exit(1);
+	}
+	Value v;
+	double start = bench_seconds();
+	if (lisp_eval(ctx, prog, &v) != 0) {
+		fprintf(stderr, "%s\n", lisp_error(ctx));
+		exit(1);
+	}
+	double elapsed = bench_seconds() - start;
+	if (v.int_value != expected) {
+		fprintf(stderr, "%s: %d, expected %d\n", src, v.int_value, expected);
+		exit(1);
+	}
+	lisp_prog_free(prog);
+	return elapsed;
+}
+
+// keys 0, 7, 14.. up to n of them straight through map_put(), on heap,
+// with the time of every put in times if it isn't NULL
+ValueMap build_map(lisp_ctx* ctx, Heap* heap, int n, double* times) {
+	jmp_buf on_error;
+	rt_enter(ctx, heap, &on_error);
+	if (setjmp(on_error) != 0) {
+		fprintf(stderr, "%s\n", ctx->error);
+		exit(1);
+	}
+	ValueMap m = {0};
+	for (int i = 0; i < n; i++) {
+		double start = bench_seconds();
+		m = map_put(m, i * 7, i);
+		if (times != NULL) {
+			times[i] = bench_seconds() - start;
+		}
+	}
+	RT = NULL;
+	return m;
+}
+
+ValueMap the_map;
+
+// (bench-map)
+Value bench_map(lisp_call* call) {
+	(void)call; // takes no args
+	return (Value){.type = V_MAP, .map_value = the_map};
+}
+
+int cmp_double(const void* a, const void* b) {
+	double x = *(const double*)a, y = *(const double*)b;
+	return (x > y) - (x < y);
+}
+
+int main(int argc, char** argv) {
+	int max_n = argc > 1 ? atoi(argv[1]) : 10000000;
+
+	lisp_ctx* ctx = lisp_ctx_new();
+	lisp_add_builtin(ctx, &(lisp_builtin){
+		.name = "bench-map",
+		.num_args = 0,
+		.arg_types = (ValueType[]){V_NONE},
+		.return_type = V_MAP,
+		.fn = bench_map,
+		.impure = true,
+	});
+	char src[1024];
+
+	printf("%10s %12s %12s %12s %10s\n", "entries", "put ns", "get ns", "scan ns", "speedup");
+	for (int n = 1000; n <= max_n; n *= 10) {
+		int num_gets = 1000000;
+		// the scan is O(n) per lookup, so only as many as take a moment
+		int num_scans = n <= 10000 ? 1000 : (100000000 / n > 2 ? 100000000 / n : 2);
+		int scan_step = n / num_scans + 1;
+
+		unsigned sum_gets = 0, sum_scans = 0;
+		for (int j = 0; j < num_gets; j++) {
+			sum_gets += (int)((long)j * 1009 % n);
+		}
+		for (int j = 0; j < num_scans; j++) {
+			sum_scans += (int)((long)j * scan_step % n);
+		}
+
+		snprintf(src, sizeof(src), BUILD "(map-len (build 0 %d (map-new)))", n);
+		double build = run(ctx, src, n);
+
+		Heap heap = {0};
+		the_map = build_map(ctx, &heap, n, NULL);
+		snprintf(src, sizeof(src), "(let ((m (bench-map))) "
+			"(sum (map (lambda (j) (get " KEY " m)) (range 0 %d))))", 1009, n, num_gets);
+		double gets = run(ctx, src, sum_gets);
+		heap_free_all(&heap);
+
+		snprintf(src, sizeof(src),
+			"(defun find (k ks i n) (if (= i n) -1 (if (= (nth i ks) k) i (find k ks (+ i 1) n)))) "
+			"(define ks (map (lambda (i) (* i 7)) (range 0 %d))) "
+			"(sum (map (lambda (j) (find " KEY " ks 0 %d)) (range 0 %d)))", n, scan_step, n, n, num_scans);
+		double scans = run(ctx, src, sum_scans);
+
+		printf("%10d %12.1f %12.1f %12.0f %9.0fx\n",
+			n,
+			build / n * 1e9,
+			gets / num_gets * 1e9,
+			scans / num_scans * 1e9,
+			(scans / num_scans) / (gets / num_gets));
+	}
+
+	// every put on its own clock
+	Heap heap = {0};
+	double* times = malloc(sizeof(double) * max_n);
+	ValueMap m = build_map(ctx, &heap, max_n, times);
+	qsort(times, max_n, sizeof(double), cmp_double);
+
+	// what growing the final index in one go would take
+	jmp_buf on_error;
+	rt_enter(ctx, &heap, &on_error);
+	MapTable* t = m.table;
+	map_migrate(t, t->old_cap);
+	double start = bench_seconds();
+	MapSlot* slots = map_new_slots(t->cap * 2);
+	for (int i = 0; i < t->cap; i++) {
+		if (t->slots[i].ref != 0) {
+			*map_slot(slots, t->cap * 2, t->slots[i].key) = t->slots[i];
+		}
+	}
+	double rehash = bench_seconds() - start;
+	RT = NULL;
+
+	printf("\n%d puts: median %.0f ns, 99.99%% %.0f ns, max %.0f us, a full rehash %.0f us\n",
+		max_n,
+		times[max_n / 2] * 1e9,
+		times[(long)max_n * 9999 / 10000] * 1e9,
+		times[max_n - 1] * 1e6,
+		rehash * 1e6);
+
+	heap_free_all(&heap);
+	free(times);
+	lisp_ctx_free(ctx);
+	return 0;
+}
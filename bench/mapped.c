@@ -0,0 +1,123 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "lisp.h"
+
+// reductions over a file of ints through load-ints, against the same
+// ints spelled out as (list ...) in the source. the file is written once,
+// then each program is run over it and timed, with the process's max rss
+// after it. the mapped lists let go of their pages as they go, so the rss
+// stays about the same however large the file is. every result is
+// checked against one computed here
+//
+// usage: mapped [megabytes] [threads]
+
+double now_seconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+long max_rss_kb() {
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_maxrss;
+}
+
+unsigned next_rand(unsigned* seed) {
+	*seed = *seed * 1103515245 + 12345;
+	return *seed >> 16;
+}
+
+int run(lisp_ctx* ctx, const char* label, const char* src, size_t len, long num_ints, int expected) {
+	double start = now_seconds();
+	Value v;
+	if (lisp_eval_source(ctx, src, len, &v) != 0) {
+		fprintf(stderr, "%s: %s\n", label, lisp_error(ctx));
+		return 1;
+	}
+	double elapsed = now_seconds() - start;
+	if (v.int_value != expected) {
+		fprintf(stderr, "%s: %d, expected %d\n", label, v.int_value, expected);
+		return 1;
+	}
+	printf("%-34s %10.1f %10.2f %12ld\n", label, elapsed * 1e3, elapsed / num_ints * 1e9, max_rss_kb());
+	return 0;
+}
+
+int main(int argc, char** argv) {
+	long megabytes = argc > 1 ? atol(argv[1]) : 2048;
+	int num_threads = argc > 2 ? atoi(argv[2]) : 1;
+
+	long num_ints = (megabytes << 20) / 4;
+	char path[64];
+	snprintf(path, sizeof(path), "/tmp/lisp-mapped-%d.bin", (int)getpid());
+
+	// the file, a block at a time, and what each program should give
+	FILE* f = fopen(path, "wb");
+	if (f == NULL) {
+		perror(path);
+		return 1;
+	}
+	int32_t block[4096];
+	unsigned seed = 1;
+	uint32_t sum = 0, sum_odd_sq = 0;
+	int32_t max = INT32_MIN;
+	for (long i = 0; i < num_ints; i += 4096) {
+		int n = num_ints - i < 4096 ? num_ints - i : 4096;
+		for (int k = 0; k < n; k++) {
+			int32_t x = (int32_t)(next_rand(&seed) % 2001) - 1000;
+			block[k] = x; // little-endian hosts only
+			sum += (uint32_t)x;
+			sum_odd_sq += x % 2 != 0 ? (uint32_t)(x * x) : 0;
+			max = x > max ? x : max;
+		}
+		fwrite(block, sizeof(int32_t), n, f);
+	}
+	fclose(f);
+
+	lisp_ctx* ctx = lisp_ctx_new();
+	lisp_set_threads(ctx, num_threads, 1 << 16);
+
+	printf("%ld MB file of %ld int32s, %d threads, max rss %ld KB before\n",
+		megabytes, num_ints, num_threads, max_rss_kb());
+	printf("%-34s %10s %10s %12s\n", "", "ms", "ns/int", "max rss KB");
+
+	char src[256];
+	int status = 0;
+	#define RUN(label, fmt, expected) \
+		do { \
+			snprintf(src, sizeof(src), fmt, path); \
+			status |= run(ctx, label, src, strlen(src), num_ints, expected); \
+		} while(0)
+
+	RUN("len", "(len (load-ints \"%s\"))", (int)num_ints);
+	RUN("sum", "(sum (load-ints \"%s\"))", (int)sum);
+	RUN("max", "(max (load-ints \"%s\"))", max);
+	RUN("sum of sq of odd", "(sum (map sq (filter odd (load-ints \"%s\"))))", (int)sum_odd_sq);
+
+	// the first few thousand again, spelled out in the source
+	long num_listed = num_ints < 1 << 16 ? num_ints : 1 << 16;
+	size_t cap = num_listed * 8 + 64;
+	char* list_src = malloc(cap);
+	size_t len = sprintf(list_src, "(sum (list");
+	seed = 1;
+	uint32_t listed_sum = 0;
+	for (long i = 0; i < num_listed; i++) {
+		int x = (int)(next_rand(&seed) % 2001) - 1000;
+		listed_sum += (uint32_t)x;
+		len += sprintf(list_src + len, " %d", x);
+	}
+	len += sprintf(list_src + len, "))");
+	status |= run(ctx, "sum of (list ...) in the source", list_src, len, num_listed, (int)listed_sum);
+
+	free(list_src);
+	lisp_ctx_free(ctx);
+	remove(path);
+	return status;
+}
@@ -0,0 +1,89 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "lisp.h"
+
+// builtins from a plugin (see lisp_load_plugin()), in ns per element of
+// a range of n: square against the builtin sq, which does the same thing,
+// to show that a plugin's builtin is called no differently, then gcd and
+// isqrt against the same code written in the language, which is what
+// there was before plugins. every pair has to give the same result
+//
+// usage: plugin [n] [plugin.so]
+
+double now_seconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// ns per element, and the result in *out
+double run(lisp_ctx* ctx, const char* fmt, int n, int* out) {
+	char src[1024];
+	snprintf(src, sizeof(src), fmt, n);
+
+	lisp_prog* prog = lisp_compile(ctx, src, strlen(src));
+	if (prog == NULL) {
+		fprintf(stderr, "%s: %s\n", src, lisp_error(ctx));
+		exit(1);
+	}
+	Value v;
+	double start = now_seconds();
+	if (lisp_eval(ctx, prog, &v) != 0) {
+		fprintf(stderr, "%s: %s\n", src, lisp_error(ctx));
+		exit(1);
+	}
+	double elapsed = now_seconds() - start;
+	lisp_prog_free(prog);
+
+	*out = v.int_value;
+	return elapsed / n * 1e9;
+}
+
+void compare(lisp_ctx* ctx, const char* name, const char* before, const char* after, int n) {
+	int expected, got;
+	double ns_before = run(ctx, before, n, &expected);
+	double ns_after = run(ctx, after, n, &got);
+	if (got != expected) {
+		fprintf(stderr, "%s: %d, expected %d\n", name, got, expected);
+		exit(1);
+	}
+	printf("%-24s %12.2f %12.2f %10.2fx\n", name, ns_before, ns_after, ns_before / ns_after);
+}
+
+int main(int argc, char** argv) {
+	int n = argc > 1 ? atoi(argv[1]) : 10000000;
+	const char* path = argc > 2 ? argv[2] : "plugins/libintmath.so";
+
+	lisp_ctx* ctx = lisp_ctx_new();
+	if (lisp_load_plugin(ctx, path) != 0) {
+		fprintf(stderr, "%s\n", lisp_error(ctx));
+		return 1;
+	}
+
+	printf("%-24s %12s %12s %11s\n", "", "before ns", "plugin ns", "speedup");
+
+	compare(ctx, "map sq / square",
+		"(sum (map sq (range 0 %d)))",
+		"(sum (map square (range 0 %d)))",
+		n);
+	compare(ctx, "call sq / square",
+		"(defun f (i acc) (if (= i 0) acc (f (- i 1) (+ acc (sq i))))) (f %d 0)",
+		"(defun f (i acc) (if (= i 0) acc (f (- i 1) (+ acc (square i))))) (f %d 0)",
+		n);
+	compare(ctx, "gcd",
+		"(defun g (a b) (if (= b 0) a (g b (%% a b)))) (sum (map (lambda (x) (g x 1071)) (range 1 %d)))",
+		"(sum (map (lambda (x) (gcd x 1071)) (range 1 %d)))",
+		n / 10);
+	compare(ctx, "isqrt",
+		// counting up, there is no division to bisect with
+		"(defun s (x r) (if (> (* (+ r 1) (+ r 1)) x) r (s x (+ r 1))))"
+		" (sum (map (lambda (x) (s x 0)) (range 0 %d)))",
+		"(sum (map isqrt (range 0 %d)))",
+		n / 100);
+
+	lisp_ctx_free(ctx);
+	return 0;
+}
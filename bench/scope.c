@@ -0,0 +1,92 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "lisp.h"
+
+// cost of a variable access as the scope around it grows: a let with
+// `size` bindings whose body adds up `refs` references to the first and
+// last of them from one scope further in. lookups are resolved to
+// (depth, slot) by parse(), so the time per access should not depend on
+// the size of the scope
+//
+// usage: scope [refs] [evals]
+
+double now_seconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// program with `size` bindings and `refs` variable references
+char* make_program(int size, int refs) {
+	size_t cap = (size_t)size * 32 + (size_t)refs * 32 + 64;
+	char* src = malloc(cap);
+	size_t len = 0;
+
+	len += sprintf(src + len, "(let (");
+	for (int i = 0; i < size - 1; i++) {
+		len += sprintf(src + len, "(v%d %d) ", i, i);
+	}
+	len += sprintf(src + len, "(vlast %d)", size - 1);
+	len += sprintf(src + len, ") (let ((inner 0)) ");
+
+	for (int i = 0; i < refs; i++) {
+		len += sprintf(src + len, "(+ %s ", i % 2 ? "v0" : "vlast");
+	}
+	len += sprintf(src + len, "inner");
+	for (int i = 0; i < refs; i++) {
+		src[len++] = ')';
+	}
+	len += sprintf(src + len, "))");
+
+	return src;
+}
+
+double time_evals(lisp_ctx* ctx, char* src, int evals) {
+	lisp_prog* prog = lisp_compile(ctx, src, strlen(src));
+	if (prog == NULL) {
+		fprintf(stderr, "%s\n", lisp_error(ctx));
+		exit(1);
+	}
+
+	Value v;
+	double start = now_seconds();
+	for (int i = 0; i < evals; i++) {
+		if (lisp_eval(ctx, prog, &v) != 0) {
+			fprintf(stderr, "%s\n", lisp_error(ctx));
+			exit(1);
+		}
+	}
+	double elapsed = now_seconds() - start;
+
+	lisp_prog_free(prog);
+	return elapsed;
+}
+
+int main(int argc, char** argv) {
+	int refs = argc > 1 ? atoi(argv[1]) : 2000;
+	int evals = argc > 2 ? atoi(argv[2]) : 2000;
+
+	lisp_ctx* ctx = lisp_ctx_new();
+
+	for (int size = 10; size <= 100000; size *= 10) {
+		char* base = make_program(size, 0);
+		char* test = make_program(size, refs);
+
+		// the bindings themselves cost O(size) per eval, take them out
+		double t_base = time_evals(ctx, base, evals);
+		double t_test = time_evals(ctx, test, evals);
+
+		printf("scope size %6d: %.2f ns per access (including one +)\n",
+			size,
+			(t_test - t_base) * 1e9 / ((double)evals * refs));
+
+		free(base);
+		free(test);
+	}
+
+	lisp_ctx_free(ctx);
+	return 0;
+}
@@ -0,0 +1,176 @@
+#include <ctype.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// tokenize() is internal, so this benchmark builds lisp.c into itself
+#include "../lisp.c"
+
+// tokenizer throughput on a large generated program, for the byte at a
+// time scan the tokenizer used to be and for each classifier this cpu
+// can run. classify is the SIMD scan alone, tokenize is the whole of
+// tokenize_with() including writing the tokens out. every variant's
+// tokens are checked against the byte at a time ones
+//
+// usage: tokenize [megabytes] [runs]
+
+double bench_seconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// the old tokenizer: isspace() per byte, one realloc per token
+TokenList tokenize_bytewise(char* prog, size_t n) {
+	TokenList l = tl_new();
+	size_t i = 0;
+	while (i < n) {
+		char c = prog[i];
+		Token t;
+		if (c == '(') {
+			t = (Token){.type=T_OPEN_PAREN};
+			i++;
+		} else if (c == ')') {
+			t = (Token){.type=T_CLOSE_PAREN};
+			i++;
+		} else if (isspace(c)) {
+			i++;
+			continue;
+		} else {
+			// a string literal goes on to its closing quote
+			size_t start = i;
+			bool in_string = false;
+			while (i < n && (in_string || (prog[i] != '(' && prog[i] != ')' && !isspace(prog[i])))) {
+				in_string ^= prog[i] == '"';
+				i++;
+			}
+			t = (Token){.type=T_ATOM, .atom_str=&prog[start], .atom_len=i - start};
+		}
+		l.len++;
+		l.tokens = rt_realloc(l.tokens, sizeof(Token) * l.len);
+		l.tokens[l.len - 1] = t;
+	}
+	return l;
+}
+
+// nested calls, lists, defuns and strings with a mix of whitespace
+char* make_program(size_t size, size_t* out_len) {
+	static const char* pieces[] = {
+		"(+ (sq 12345) (len (list 1 2 3 4 5 6 7 8)))\n",
+		"(defun f (n)\n\t(if (< n 2) 1 (+ (f (- n 1)) (f (- n 2)))))\n",
+		"(sum (map sq (filter odd (range 0 1000000))))  ",
+		"(let ((a_long_variable_name 1) (b 2))\r\n  (* a_long_variable_name b))\n",
+		"((((((((((0))))))))))",
+		"(len (load-ints \"/data/a file (v2).bin\"))\n",
+	};
+	int num_pieces = sizeof(pieces) / sizeof(pieces[0]);
+
+	char* src = malloc(size + 256);
+	size_t len = 0;
+	unsigned seed = 1;
+	while (len < size) {
+		seed = seed * 1103515245 + 12345;
+		const char* p = pieces[(seed >> 16) % num_pieces];
+		size_t n = strlen(p);
+		memcpy(src + len, p, n);
+		len += n;
+	}
+	src[len] = '\0';
+	*out_len = len;
+	return src;
+}
+
+bool same_tokens(TokenList a, TokenList b) {
+	if (a.len != b.len) {
+		return false;
+	}
+	for (int i = 0; i < a.len; i++) {
+		if (a.tokens[i].type != b.tokens[i].type
+		|| a.tokens[i].atom_str != b.tokens[i].atom_str
+		|| a.tokens[i].atom_len != b.tokens[i].atom_len) {
+			return false;
+		}
+	}
+	return true;
+}
+
+typedef struct {
+	const char* name;
+	ClassifyFn classify; // NULL for the byte at a time scan
+} Variant;
+
+int main(int argc, char** argv) {
+	size_t megabytes = argc > 1 ? atoi(argv[1]) : 16;
+	int runs = argc > 2 ? atoi(argv[2]) : 5;
+
+	size_t len;
+	char* src = make_program(megabytes << 20, &len);
+
+	lisp_ctx* ctx = lisp_ctx_new();
+	Heap heap = {0};
+	jmp_buf on_error;
+	rt_enter(ctx, &heap, &on_error);
+	if (setjmp(on_error) != 0) {
+		fprintf(stderr, "%s\n", ctx->error);
+		return 1;
+	}
+
+	Variant variants[4] = {
+		{"bytewise", NULL},
+		{"scalar", classify_scalar},
+	};
+	int num_variants = 2;
+#if defined(__x86_64__)
+	variants[num_variants++] = (Variant){"sse2", classify_sse2};
+	if (__builtin_cpu_supports("avx2")) {
+		variants[num_variants++] = (Variant){"avx2", classify_avx2};
+	}
+#endif
+
+	TokenList expected = tokenize_bytewise(src, len);
+	printf("%zu bytes, %d tokens\n", len, expected.len);
+	printf("%-10s %16s %16s\n", "", "classify", "tokenize");
+
+	CharMasks* masks = malloc(sizeof(CharMasks) * (len / 64 + 1));
+
+	for (int v = 0; v < num_variants; v++) {
+		double best_classify = 1e9, best_tokenize = 1e9;
+		for (int r = 0; r < runs; r++) {
+			double start = bench_seconds();
+			if (variants[v].classify != NULL) {
+				variants[v].classify(src, len / 64, masks);
+			}
+			double mid = bench_seconds();
+			TokenList tl = variants[v].classify == NULL
+				? tokenize_bytewise(src, len)
+				: tokenize_with(variants[v].classify, src, len);
+			double end = bench_seconds();
+
+			if (!same_tokens(tl, expected)) {
+				printf("%s: token stream differs\n", variants[v].name);
+				return 1;
+			}
+			rt_free(tl.tokens);
+			if (mid - start < best_classify) {
+				best_classify = mid - start;
+			}
+			if (end - mid < best_tokenize) {
+				best_tokenize = end - mid;
+			}
+		}
+
+		if (variants[v].classify == NULL) {
+			printf("%-10s %16s", variants[v].name, "-");
+		} else {
+			printf("%-10s %11.3f GB/s", variants[v].name, len / best_classify / 1e9);
+		}
+		printf(" %11.3f GB/s\n", len / best_tokenize / 1e9);
+	}
+
+	free(masks);
+	heap_free_all(&heap);
+	lisp_ctx_free(ctx);
+	free(src);
+	return 0;
+}
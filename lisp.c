@@ -1,35 +1,501 @@
 #include <assert.h>
 #include <ctype.h>
+#include <dlfcn.h>
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <math.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "lisp.h"
 
 // lisp-like calculator (uses prefix notation)
 
+/*	memory: everything allocated while compiling or evaluating goes through
+	a Heap, which remembers its blocks so that a program, the values of one
+	evaluation, or whatever was left behind by an error can be released in
+	one go */
+
+typedef struct HeapBlock {
+	struct HeapBlock* prev;
+	struct HeapBlock* next;
+	size_t size;
+	max_align_t data[];
+} HeapBlock;
+
+typedef struct {
+	HeapBlock* head;
+	size_t bytes; // total size of live blocks
+} Heap;
+
+#define heap_block(ptr) \
+	((HeapBlock*)((char*)(ptr) - offsetof(HeapBlock, data)))
+
+void heap_link(Heap* h, HeapBlock* b) {
+	b->prev = NULL;
+	b->next = h->head;
+	if (h->head != NULL) {
+		h->head->prev = b;
+	}
+	h->head = b;
+}
+
+void heap_unlink(Heap* h, HeapBlock* b) {
+	if (b->prev != NULL) {
+		b->prev->next = b->next;
+	} else {
+		h->head = b->next;
+	}
+	if (b->next != NULL) {
+		b->next->prev = b->prev;
+	}
+}
+
+void* heap_realloc(Heap* h, void* ptr, size_t size) {
+	HeapBlock* b = NULL;
+
+	if (ptr != NULL) {
+		b = heap_block(ptr);
+		heap_unlink(h, b);
+		h->bytes -= b->size;
+	}
+
+	HeapBlock* nb = realloc(b, sizeof(HeapBlock) + size);
+	if (nb == NULL) {
+		// the old block is still valid, keep it owned by the heap
+		if (b != NULL) {
+			heap_link(h, b);
+			h->bytes += b->size;
+		}
+		return NULL;
+	}
+
+	nb->size = size;
+	h->bytes += size;
+	heap_link(h, nb);
+	return nb->data;
+}
+
+// heap_realloc(h, NULL, size) zeroed. calloc() knows when it gets a large
+// block straight from the kernel, whose pages are zero already and are
+// only faulted in as they are first used
+void* heap_calloc(Heap* h, size_t size) {
+	HeapBlock* b = calloc(1, sizeof(HeapBlock) + size);
+	if (b == NULL) {
+		return NULL;
+	}
+	b->size = size;
+	h->bytes += size;
+	heap_link(h, b);
+	return b->data;
+}
+
+void heap_free(Heap* h, void* ptr) {
+	if (ptr == NULL) {
+		return;
+	}
+	HeapBlock* b = heap_block(ptr);
+	heap_unlink(h, b);
+	h->bytes -= b->size;
+	free(b);
+}
+
+void heap_free_all(Heap* h) {
+	HeapBlock* b = h->head;
+	while (b != NULL) {
+		HeapBlock* next = b->next;
+		free(b);
+		b = next;
+	}
+	*h = (Heap){0};
+}
+
+// the block src allocated first, the end of its list
+HeapBlock* heap_tail(Heap* h) {
+	HeapBlock* b = h->head;
+	while (b != NULL && b->next != NULL) {
+		b = b->next;
+	}
+	return b;
+}
+
+// move every block of src to dst, given src's heap_tail()
+void heap_splice(Heap* dst, Heap* src, HeapBlock* tail) {
+	if (src->head == NULL) {
+		return;
+	}
+	tail->next = dst->head;
+	if (dst->head != NULL) {
+		dst->head->prev = tail;
+	}
+	dst->head = src->head;
+	dst->bytes += src->bytes;
+	*src = (Heap){0};
+}
+
+#define RT_ERROR_MAX 256
+
+/*	state of the thread that is currently compiling or evaluating. each
+	thread has its own, so contexts on different threads don't interact */
+struct Scope;
+struct Frame;
+struct Trace;
+
+// budget of a parallel reduce, shared by its chunks, see par_reduce_chunk()
+typedef struct {
+	atomic_llong steps; // taken by the caller and all chunks together
+	atomic_llong bytes; // on the caller's heap and all chunk heaps together
+	atomic_bool stop; // a chunk failed, the others give up at their next check
+} SharedBudget;
+
+typedef struct {
+	lisp_ctx* ctx;
+	struct E_FuncData* builtins; // ctx->builtins.fns, what E_FUNCCALL indexes
+	Heap* heap; // where rt_alloc() and friends allocate from
+	jmp_buf* on_error; // where panic() returns to
+	char* error; // RT_ERROR_MAX bytes
+
+	struct Scope* scope; // innermost scope while parsing
+
+	// nodes of the program being parsed, see emit_kids()
+	struct Expr* nodes;
+	int num_nodes;
+	int nodes_cap;
+	int params_used; // highest $n in the program + 1
+
+	struct Frame* env; // innermost frame while evaluating
+	const int* params; // what $0, $1, ... are bound to
+	int num_params;
+
+	// slots of frames that no closure can see, see eval()
+	Value* stack;
+	int sp;
+	int stack_cap;
+
+	struct Frame* frames;
+	int fp;
+	int frames_cap;
+
+	int depth; // nested eval() calls, to fail before the C stack runs out
+	bool in_chunk; // of a parallel reduce, which can't start another one
+
+	struct Trace* trace; // NULL unless tracing, see trace_begin()
+
+	// budget of the current evaluation, see budget_check(). 0 for no limit
+	int64_t max_steps;
+	size_t max_bytes;
+	uint64_t deadline; // CLOCK_MONOTONIC ns
+
+	int64_t tick; // steps left until the next check
+	int64_t tick_start; // what tick was reset to at the last check
+	int64_t steps; // steps taken up to the last check
+
+	SharedBudget* shared; // NULL unless running a chunk of a parallel reduce
+	size_t bytes_shared; // of heap->bytes, what is counted in shared->bytes
+} RT_State;
+
+// capacity of the value and frame stacks, in Values and Frames
+#define RT_STACK_SIZE (1 << 20)
+#define RT_FRAMES_SIZE (1 << 16)
+
+// deepest non-tail recursion allowed
+#define RT_MAX_DEPTH 10000
+
+static __thread RT_State* RT;
+
+_Noreturn void rt_raise(const char* fmt, ...) {
+	va_list ap;
+	va_start(ap, fmt);
+	vsnprintf(RT->error, RT_ERROR_MAX, fmt, ap);
+	va_end(ap);
+	longjmp(*RT->on_error, 1);
+}
+
+// abort the current compile/eval, see lisp_error()
 #define panic(fmt, ...) \
+	rt_raise("runtime error: " fmt __VA_OPT__(,) __VA_ARGS__)
+
+#define rt_alloc(size) \
+	(heap_realloc(RT->heap, NULL, (size)))
+
+#define rt_realloc(ptr, size) \
+	(heap_realloc(RT->heap, (ptr), (size)))
+
+#define rt_free(ptr) \
+	(heap_free(RT->heap, (ptr)))
+
+void budget_check();
+
+// count n steps against the budget of the current evaluation. a step is
+// about one evaluated expression or one list element produced
+#define rt_charge(n) \
 	do { \
-		fprintf(stderr, \
-			"runtime error: " fmt "\n" __VA_OPT__(,) __VA_ARGS__); \
-		exit(1); \
+		RT->tick -= (n); \
+		if (RT->tick <= 0) { \
+			budget_check(); \
+		} \
 	} while(0)
 
+void* rt_calloc(size_t size) {
+	void* p = heap_calloc(RT->heap, size);
+	if (p == NULL) {
+		panic("out of memory");
+	}
+	return p;
+}
+
+/*	tracing: with lisp_set_trace(), every builtin call, every call of a
+	closure (under its defun name, or "lambda") and each phase of
+	lisp_compile() is recorded as one complete event (start and duration)
+	into a ring buffer that is allocated up front, so a capture only costs
+	two clock reads per call and never allocates. when the ring is full the
+	oldest events are overwritten. calls made by the worker threads of a
+	parallel reduction are not traced, their time shows up in the sum/len/
+	min/max call that started them */
+
+typedef struct {
+	const char* name;
+	uint64_t start; // ns
+	uint64_t dur;
+	int depth; // number of traced events around this one
+} TraceEvent;
+
+typedef struct Trace {
+	TraceEvent* events;
+	int cap;
+	uint64_t count; // recorded so far, the newest is at (count - 1) % cap
+	int depth;
+
+	// copies of the closure names in events, see trace_name()
+	char** names;
+	int num_names;
+} Trace;
+
+uint64_t trace_now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// returns the start time to pass to trace_end()
+uint64_t trace_begin() {
+	Trace* t = RT->trace;
+	if (t == NULL) {
+		return 0;
+	}
+	t->depth++;
+	return trace_now();
+}
+
+void trace_end(const char* name, uint64_t start) {
+	Trace* t = RT->trace;
+	if (t == NULL) {
+		return;
+	}
+	t->depth--;
+	t->events[t->count++ % t->cap] = (TraceEvent){
+		.name = name,
+		.start = start,
+		.dur = trace_now() - start,
+		.depth = t->depth
+	};
+}
+
+// a closure's name belongs to its program, which can be freed before the
+// trace is written, so events get the trace's own copy of it
+const char* trace_name(const char* name) {
+	Trace* t = RT->trace;
+	for (int i = 0; i < t->num_names; i++) {
+		if (strcmp(t->names[i], name) == 0) {
+			return t->names[i];
+		}
+	}
+	char** names = realloc(t->names, sizeof(char*) * (t->num_names + 1));
+	if (names == NULL) {
+		return "?";
+	}
+	t->names = names;
+	char* copy = strdup(name);
+	if (copy == NULL) {
+		return "?";
+	}
+	t->names[t->num_names++] = copy;
+	return copy;
+}
+
+// the recorded events that are still in the ring, oldest first
+TraceEvent* trace_events(Trace* t, int* out_len) {
+	int n = t->count < (uint64_t)t->cap ? (int)t->count : t->cap;
+	TraceEvent* events = malloc(sizeof(TraceEvent) * (n + 1));
+	for (int i = 0; i < n; i++) {
+		events[i] = t->events[(t->count - n + i) % t->cap];
+	}
+	*out_len = n;
+	return events;
+}
+
+void trace_write_name(FILE* f, const char* name) {
+	for (const char* c = name; *c; c++) {
+		if (*c == '"' || *c == '\\') {
+			putc('\\', f);
+		}
+		putc(*c, f);
+	}
+}
+
+// Trace Event Format, as read by chrome://tracing and Perfetto
+void trace_write_chrome(Trace* t, FILE* f) {
+	int n;
+	TraceEvent* events = trace_events(t, &n);
+
+	fprintf(f, "{\"traceEvents\":[\n");
+	for (int i = 0; i < n; i++) {
+		fprintf(f, "{\"name\":\"");
+		trace_write_name(f, events[i].name);
+		fprintf(f, "\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":1}%s\n",
+			events[i].start / 1e3,
+			events[i].dur / 1e3,
+			i == n - 1 ? "" : ",");
+	}
+	fprintf(f, "],\"displayTimeUnit\":\"ns\"}\n");
+
+	free(events);
+}
+
+// outer events first, and the outer one first when two start together
+int trace_event_cmp(const void* a, const void* b) {
+	const TraceEvent* x = a;
+	const TraceEvent* y = b;
+	if (x->start != y->start) {
+		return x->start < y->start ? -1 : 1;
+	}
+	return x->depth - y->depth;
+}
+
+// one "outer;inner;innermost self_ns" line per event, for flamegraph.pl
+void trace_write_folded(Trace* t, FILE* f) {
+	int n;
+	TraceEvent* events = trace_events(t, &n);
+	qsort(events, n, sizeof(TraceEvent), trace_event_cmp);
+
+	// the events that contain the current one, and the time their
+	// already finished children took
+	TraceEvent** stack = malloc(sizeof(TraceEvent*) * (n + 1));
+	uint64_t* child_time = malloc(sizeof(uint64_t) * (n + 1));
+	int top = 0;
+
+	for (int i = 0; i <= n; i++) {
+		// pop everything that ended before this event starts (all of it
+		// after the last event)
+		while (top > 0 && (i == n || stack[top - 1]->start + stack[top - 1]->dur <= events[i].start)) {
+			TraceEvent* done = stack[top - 1];
+			for (int j = 0; j < top; j++) {
+				fprintf(f, "%s%s", j ? ";" : "", stack[j]->name);
+			}
+			fprintf(f, " %lu\n", (unsigned long)(done->dur - child_time[top - 1]));
+
+			top--;
+			if (top > 0) {
+				child_time[top - 1] += done->dur;
+			}
+		}
+
+		if (i < n) {
+			stack[top] = &events[i];
+			child_time[top] = 0;
+			top++;
+		}
+	}
+
+	free(stack);
+	free(child_time);
+	free(events);
+}
+
+/*	budgets: lisp_eval() can be limited in steps, bytes allocated (for
+	lists, frames and everything else the evaluation keeps on its Heap) and
+	wall clock time. counting a step is a decrement and a branch (see
+	rt_charge), the actual limits are only looked at every
+	BUDGET_CHECK_EVERY steps. builtins that loop in C charge their work as
+	they go, so they can't get around the limits either */
+
+#define BUDGET_CHECK_EVERY 4096
+
+void budget_check() {
+	int64_t taken = RT->tick_start - RT->tick;
+	RT->steps += taken;
+
+	int64_t steps = RT->steps;
+	size_t bytes = RT->heap->bytes;
+
+	SharedBudget* shared = RT->shared;
+	if (shared != NULL) {
+		// a chunk is held to what all of them took, on top of the caller
+		long long freed_or_taken = (long long)RT->heap->bytes - (long long)RT->bytes_shared;
+		RT->bytes_shared = RT->heap->bytes;
+		steps = atomic_fetch_add(&shared->steps, taken) + taken;
+		bytes = atomic_fetch_add(&shared->bytes, freed_or_taken) + freed_or_taken;
+		if (atomic_load(&shared->stop)) {
+			panic("parallel reduce stopped");
+		}
+	}
+
+	if (RT->max_steps > 0 && steps > RT->max_steps) {
+		panic("step budget exceeded (%ld steps)", (long)RT->max_steps);
+	}
+	if (RT->max_bytes > 0 && bytes > RT->max_bytes) {
+		panic("memory budget exceeded (%zu bytes)", RT->max_bytes);
+	}
+	if (RT->deadline > 0 && trace_now() >= RT->deadline) {
+		panic("time budget exceeded");
+	}
+
+	int64_t next = BUDGET_CHECK_EVERY;
+	if (RT->max_steps > 0 && RT->max_steps - steps + 1 < next) {
+		// stop right after the last allowed step
+		next = RT->max_steps - steps + 1;
+	} else if (RT->max_steps == 0 && RT->max_bytes == 0 && RT->deadline == 0
+	&& shared == NULL) {
+		next = INT64_MAX / 2;
+	}
+	RT->tick = RT->tick_start = next;
+}
+
+// steps taken by the current state so far
+#define budget_steps() \
+	(RT->steps + RT->tick_start - RT->tick)
+
 // step 1: program string to list of tokens
 
 typedef enum {
 	T_NONE,
 	T_OPEN_PAREN, // 1 char
-	T_CLOSE_PAREN, // 1 char
+	T_CLOSE_PAREN, // 1 char, T_OPEN_PAREN + 1, see tokenize_with()
 	T_ATOM // <len> chars
 } TokenType;
 
 typedef struct {
-	TokenType type;
-	
 	char* atom_str;
 	int atom_len;
+	TokenType type; // after the pointer, to keep a Token at 16 bytes
 } Token;
 
 #define token_fmt \
@@ -57,18 +523,6 @@ typedef struct {
 #define tl_new() \
 	((TokenList){0})
 
-#define tl_resize(tl, n) \
-	do { \
-		(tl).len = (n); \
-		(tl).tokens = realloc((tl).tokens, sizeof(Token) * (tl).len); \
-	} while(0)
-
-#define tl_append(tl, ... ) \
-	do { \
-		tl_resize((tl), (tl).len + 1); \
-		(tl).tokens[(tl).len - 1] = (__VA_ARGS__); \
-	} while(0)
-
 #define tl_print(tl) \
 	do { \
 		for (int i = 0; i < (tl).len; i++) { \
@@ -76,43 +530,226 @@ typedef struct {
 		} \
 	} while(0)
 
-TokenList tokenize(char* prog) {
-	TokenList l = tl_new();
-	
-	int i = 0;
-	int n = strlen(prog);
-	while (i < n) {
-		char c = prog[i];
-
-		if (c == '(') {
-			tl_append(l, (Token){.type=T_OPEN_PAREN});
-		} else if (c == ')') {
-			tl_append(l, (Token){.type=T_CLOSE_PAREN});
-		} else if (c == '\n' || isspace(c)) {
-			i++;
-			continue;
-		} else {
-			Token t = { .type=T_ATOM, .atom_str=&prog[i], .atom_len=1 };
-			while (prog[i] != '(' && prog[i] != ')' && !isspace(prog[i])) {
-				t.atom_len++;
-				i++;
-			}
-			// remove extra character
-			t.atom_len -= 1;
-			i--;
+/*	the tokenizer classifies the program 64 bytes at a time into bitmasks
+	of whitespace, parens and quotes, using AVX2 or SSE2 when the cpu has
+	them. every other byte is an atom byte, like in a byte-at-a-time scan,
+	and so is every byte of a "string literal", found with a prefix xor
+	of the quotes (strings have no escapes). the tokens are counted from
+	the masks first, so the token list is allocated once at its final
+	size, and then emitted by walking the set bits */
+
+// bit i is set if byte i of a 64 byte block is whitespace / a paren / a "
+typedef struct {
+	uint64_t space;
+	uint64_t paren;
+	uint64_t quote;
+} CharMasks;
+
+typedef void (*ClassifyFn)(const char* s, size_t num_blocks, CharMasks* out);
+
+// whitespace is what isspace() accepts in the C locale: '\t'..'\r' and ' '
+void classify_scalar(const char* s, size_t num_blocks, CharMasks* out) {
+	for (size_t b = 0; b < num_blocks; b++) {
+		uint64_t space = 0, paren = 0, quote = 0;
+		for (int i = 0; i < 64; i++) {
+			unsigned char c = s[b * 64 + i];
+			space |= (uint64_t)(c == ' ' || (c >= '\t' && c <= '\r')) << i;
+			paren |= (uint64_t)((c | 1) == ')') << i;
+			quote |= (uint64_t)(c == '"') << i;
+		}
+		out[b] = (CharMasks){space, paren, quote};
+	}
+}
+
+#if defined(__x86_64__)
+
+// c - '\t' <= '\r' - '\t' as unsigned bytes is the '\t'..'\r' range check,
+// and '(' | 1 == ')' finds both parens with one compare
+
+void classify_sse2(const char* s, size_t num_blocks, CharMasks* out) {
+	const __m128i tab = _mm_set1_epi8('\t');
+	const __m128i range = _mm_set1_epi8('\r' - '\t');
+	const __m128i blank = _mm_set1_epi8(' ');
+	const __m128i one = _mm_set1_epi8(1);
+	const __m128i close = _mm_set1_epi8(')');
+	const __m128i dquote = _mm_set1_epi8('"');
+
+	for (size_t b = 0; b < num_blocks; b++) {
+		uint64_t space = 0, paren = 0, quote = 0;
+		for (int i = 0; i < 4; i++) {
+			__m128i c = _mm_loadu_si128((const __m128i*)(s + b * 64 + i * 16));
+			__m128i t = _mm_sub_epi8(c, tab);
+			__m128i ws = _mm_or_si128(
+				_mm_cmpeq_epi8(c, blank),
+				_mm_cmpeq_epi8(_mm_min_epu8(t, range), t));
+			__m128i pa = _mm_cmpeq_epi8(_mm_or_si128(c, one), close);
+			space |= (uint64_t)(uint16_t)_mm_movemask_epi8(ws) << (i * 16);
+			paren |= (uint64_t)(uint16_t)_mm_movemask_epi8(pa) << (i * 16);
+			quote |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(c, dquote)) << (i * 16);
+		}
+		out[b] = (CharMasks){space, paren, quote};
+	}
+}
+
+__attribute__((target("avx2")))
+void classify_avx2(const char* s, size_t num_blocks, CharMasks* out) {
+	const __m256i tab = _mm256_set1_epi8('\t');
+	const __m256i range = _mm256_set1_epi8('\r' - '\t');
+	const __m256i blank = _mm256_set1_epi8(' ');
+	const __m256i one = _mm256_set1_epi8(1);
+	const __m256i close = _mm256_set1_epi8(')');
+	const __m256i dquote = _mm256_set1_epi8('"');
+
+	for (size_t b = 0; b < num_blocks; b++) {
+		uint64_t space = 0, paren = 0, quote = 0;
+		for (int i = 0; i < 2; i++) {
+			__m256i c = _mm256_loadu_si256((const __m256i*)(s + b * 64 + i * 32));
+			__m256i t = _mm256_sub_epi8(c, tab);
+			__m256i ws = _mm256_or_si256(
+				_mm256_cmpeq_epi8(c, blank),
+				_mm256_cmpeq_epi8(_mm256_min_epu8(t, range), t));
+			__m256i pa = _mm256_cmpeq_epi8(_mm256_or_si256(c, one), close);
+			space |= (uint64_t)(uint32_t)_mm256_movemask_epi8(ws) << (i * 32);
+			paren |= (uint64_t)(uint32_t)_mm256_movemask_epi8(pa) << (i * 32);
+			quote |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(c, dquote)) << (i * 32);
+		}
+		out[b] = (CharMasks){space, paren, quote};
+	}
+}
+
+#endif
+
+// the fastest classifier this cpu supports
+ClassifyFn classify_select(void) {
+#if defined(__x86_64__)
+	if (__builtin_cpu_supports("avx2")) {
+		return classify_avx2;
+	}
+	return classify_sse2;
+#else
+	return classify_scalar;
+#endif
+}
+
+// bit i of the result is the xor of bits 0..i of x: set from an opening
+// quote up to, but not including, the closing one
+uint64_t prefix_xor(uint64_t x) {
+	x ^= x << 1;
+	x ^= x << 2;
+	x ^= x << 4;
+	x ^= x << 8;
+	x ^= x << 16;
+	x ^= x << 32;
+	return x;
+}
+
+TokenList tokenize_with(ClassifyFn classify, char* prog, size_t n) {
+
+	if (n > INT_MAX) {
+		panic("program too large");
+	}
+
+	// the last partial block is classified from a copy padded with spaces,
+	// so nothing past the end counts as an atom byte
+	size_t num_blocks = (n + 63) / 64;
+	CharMasks* masks = rt_alloc(sizeof(CharMasks) * (num_blocks + 1));
+	if (masks == NULL) {
+		panic("out of memory");
+	}
+	classify(prog, n / 64, masks);
+	if (n % 64 != 0) {
+		char tail[64];
+		memset(tail, ' ', sizeof(tail));
+		memcpy(tail, prog + n / 64 * 64, n % 64);
+		classify(tail, 1, &masks[n / 64]);
+	}
+
+	// a string literal is one atom, whitespace and parens in it included.
+	// in_string is all ones when the previous block ended inside one
+	uint64_t in_string = 0;
+	for (size_t b = 0; b < num_blocks; b++) {
+		if ((masks[b].quote | in_string) != 0) {
+			uint64_t inside = prefix_xor(masks[b].quote) ^ in_string;
+			masks[b].space &= ~inside;
+			masks[b].paren &= ~inside;
+			in_string = (uint64_t)((int64_t)inside >> 63);
+		}
+	}
+	if (in_string != 0) {
+		panic("parse error: unterminated string");
+	}
+
+	// a token starts at each paren and at each atom byte that doesn't
+	// follow another atom byte. carry is the last bit of the previous block
+	size_t count = 0;
+	uint64_t carry = 0;
+	for (size_t b = 0; b < num_blocks; b++) {
+		uint64_t atom = ~(masks[b].space | masks[b].paren);
+		count += __builtin_popcountll(masks[b].paren | (atom & ~(atom << 1 | carry)));
+		carry = atom >> 63;
+	}
+
+	TokenList l = {.tokens = rt_alloc(sizeof(Token) * (count + 1)), .len = count};
+	if (l.tokens == NULL) {
+		panic("out of memory");
+	}
+
+	// atoms are emitted at their first byte, so the tokens come out in
+	// order. one that runs into the next block gets its length from there
+	Token* out = l.tokens;
+	Token* open_atom = NULL;
+	carry = 0;
+
+	for (size_t b = 0; b < num_blocks; b++) {
+		size_t base = b * 64;
+		uint64_t paren = masks[b].paren;
+		uint64_t delim = masks[b].space | paren;
+		uint64_t atom = ~delim;
+
+		if (open_atom != NULL && delim != 0) {
+			open_atom->atom_len = &prog[base + __builtin_ctzll(delim)] - open_atom->atom_str;
+			open_atom = NULL;
+		}
+
+		uint64_t starts = paren | (atom & ~(atom << 1 | carry));
+		carry = atom >> 63;
+
+		// written without branches on the token type, which is as good as
+		// random in real programs. a paren is its own delimiter, so its end
+		// is its start
+		while (starts != 0) {
+			int i = __builtin_ctzll(starts);
+			starts &= starts - 1;
+
+			uint64_t after = delim & (~0ULL << i);
+			int end = after != 0 ? __builtin_ctzll(after) : 64;
+			bool is_paren = paren >> i & 1;
 
-			// avoid appending Token{""}
-			if (t.atom_len > 0) {
-				tl_append(l, t);
+			*out = (Token){
+				.atom_str = is_paren ? NULL : &prog[base + i],
+				.atom_len = end - i,
+				.type = is_paren ? T_OPEN_PAREN + (prog[base + i] == ')') : T_ATOM
+			};
+			if (end == 64) {
+				open_atom = out;
 			}
+			out++;
 		}
-		
-		i++;
 	}
 
+	if (open_atom != NULL) {
+		open_atom->atom_len = &prog[n] - open_atom->atom_str;
+	}
+
+	rt_free(masks);
 	return l;
 }
 
+// the first n bytes of prog
+TokenList tokenize(char* prog, size_t n) {
+	return tokenize_with(classify_select(), prog, n);
+}
+
 // step 2: list of tokens to ast tree
 
 typedef enum {
@@ -132,7 +769,7 @@ typedef struct ASTNode {
 } ASTNode;
 
 #define node_new() \
-	(calloc(1, sizeof(ASTNode)))
+	(rt_calloc(sizeof(ASTNode)))
 
 void node_print_rec(ASTNode* node, int level) {
 	for (int i = 0; i < level; i++) {
@@ -160,7 +797,7 @@ void node_print_rec(ASTNode* node, int level) {
 #define list_resize(node, n) \
 	do { \
 		(node)->list_len = (n); \
-		(node)->list_items = realloc((node)->list_items, sizeof(ASTNode*) * (node)->list_len); \
+		(node)->list_items = rt_realloc((node)->list_items, sizeof(ASTNode*) * (node)->list_len); \
 	} while(0)
 
 // arg must be a ASTNode*
@@ -214,8 +851,7 @@ ASTNode* make_ast_list_simple(TokenList tl) {
 
 			// reached end without level=0 again
 			if (i >= tl.len - 1) {
-				printf("parse error");
-				return NULL;
+				panic("parse error");
 			}
 
 			// now i = index of open paren
@@ -248,9 +884,59 @@ ASTNode* make_ast(TokenList tl) {
 	}
 
 	else {
-		printf("parse error\n");
-		return NULL;
+		panic("parse error");
+	}
+}
+
+// append the top level forms in tl to the items of forms
+void append_ast_forms(ASTNode* forms, TokenList tl) {
+
+	int i = 0;
+	while (i < tl.len) {
+		int j = i;
+
+		if (tl.tokens[i].type == T_OPEN_PAREN) {
+			// find matching close paren
+			int level = 0;
+			for (; j < tl.len; j++) {
+				if (tl.tokens[j].type == T_OPEN_PAREN) {
+					level++;
+				} else if (tl.tokens[j].type == T_CLOSE_PAREN) {
+					level--;
+					if (level == 0) {
+						break;
+					}
+				}
+			}
+			if (j == tl.len) {
+				panic("parse error: unbalanced parens");
+			}
+		} else if (tl.tokens[i].type == T_CLOSE_PAREN) {
+			panic("parse error: unexpected )");
+		}
+
+		TokenList form = {
+			.tokens = tl.tokens + i,
+			.len = j - i + 1
+		};
+		list_append(forms, make_ast(form));
+		i = j + 1;
+	}
+}
+
+// a program is any number of top level forms, returned as the items of
+// an A_LIST node
+ASTNode* make_ast_forms(TokenList tl) {
+
+	ASTNode* forms = node_new();
+	forms->type = A_LIST;
+	append_ast_forms(forms, tl);
+
+	if (forms->list_len == 0) {
+		panic("parse error: empty program");
 	}
+
+	return forms;
 }
 
 // step 3: ast tree to expr tree
@@ -263,45 +949,173 @@ typedef struct {
 	int len;
 } E_Ident;
 
-// a value returned from the program
-typedef enum {
-	V_NONE,
-	V_INT,
-	V_LIST // list of values
-} ValueType;
-
-struct Value;
-
+// Value and ValueList are in lisp.h
+
+/*	lists never change once they are built, so copies of a Value can share
+	its values. every list lives in a buffer that starts with a VecHeader,
+	and a ValueList is a view of num_values of them, start values into the
+	buffer. slicing a list only makes a new view. the slots of a buffer
+	that some list has claimed (used) never change again, so a list can
+	grow in place into the slots right after it as long as nobody else has
+	claimed them, and every list that already shares the buffer still sees
+	exactly the values it had. otherwise, or once the buffer is full, the
+	list is copied into a new buffer with twice the room. claiming slots
+	isn't atomic, so only code allocating on the buffer's own heap grows
+	in place: a chunk of a parallel reduce has its own heap, and pushing
+	to a list it captured copies it. pushing to the newest version of a
+	list is amortized O(1), pushing to an older one costs a copy. a
+	builtin building a new list that nobody else can see yet uses
+	vl_append(), which just reallocs the buffer instead */
 typedef struct {
-	struct Value* values;
-	int num_values;
-} ValueList;
+	Heap* heap; // that the buffer is on
+	int used;
+	int cap;
+} VecHeader;
+
+#define vl_header(vl) \
+	((VecHeader*)((vl).values - (vl).start) - 1)
 
 #define vl_new() \
 	((ValueList){0})
 
-#define vl_resize(vl, n) \
-	do { \
-		(vl).num_values = (n); \
-		(vl).values = realloc((vl).values, sizeof(Value) * (vl).num_values); \
-	} while(0)
+/*	a list from load-ints has no buffer of Values: it is a view of a
+	mapped file of little-endian ints, with start VL_INT32 or VL_INT64 for
+	their width and values pointing at the first one. nothing that can
+	see one may index values directly, they go through vl_get(). growing
+	such a list copies it into a buffer like any shared list */
+#define VL_INT32 (-4)
+#define VL_INT64 (-8)
+
+#define vl_mapped(vl) \
+	((vl).start < 0)
+
+// the pages of a mapped list are let go of a window at a time as it is
+// read, see vl_release()
+#define MAPPED_WINDOW (1 << 22)
+
+// element i of a mapped list as it is in the file
+int64_t vl_mapped_raw(ValueList vl, int i) {
+	if (vl.start == VL_INT32) {
+		return (int32_t)le32toh(((const uint32_t*)vl.values)[i]);
+	}
+	return (int64_t)le64toh(((const uint64_t*)vl.values)[i]);
+}
+
+// element i of a mapped list as an int
+int vl_mapped_int(ValueList vl, int i) {
+	int64_t n = vl_mapped_raw(vl, i);
+	if (n < INT_MIN || n > INT_MAX) {
+		panic("list element %lld doesn't fit in an int", (long long)n);
+	}
+	return n;
+}
+
+Value vl_get(ValueList vl, int i) {
+	if (vl_mapped(vl)) {
+		return (Value){.type = V_INT, .int_value = vl_mapped_int(vl, i)};
+	}
+	return vl.values[i];
+}
+
+// a view of elements [lo, hi) of vl
+ValueList vl_slice(ValueList vl, int lo, int hi) {
+	if (vl_mapped(vl)) {
+		return (ValueList){
+			.values = (Value*)((char*)vl.values + (size_t)lo * -vl.start),
+			.num_values = hi - lo,
+			.start = vl.start
+		};
+	}
+	return (ValueList){.values = vl.values + lo, .num_values = hi - lo, .start = vl.start + lo};
+}
+
+// hand the pages under elements [lo, hi) of a mapped list back to the
+// kernel, they are read in again from the file if they are used again
+void vl_release(ValueList vl, int lo, int hi) {
+	uintptr_t page = sysconf(_SC_PAGESIZE);
+	uintptr_t from = ((uintptr_t)vl.values + (size_t)lo * -vl.start + page - 1) & ~(page - 1);
+	uintptr_t to = ((uintptr_t)vl.values + (size_t)hi * -vl.start) & ~(page - 1);
+	if (to > from) {
+		madvise((void*)from, to - from, MADV_DONTNEED);
+	}
+}
+
+// vl in a new buffer with room for cap values
+ValueList vl_copy(ValueList vl, int cap) {
+	VecHeader* h = rt_alloc(sizeof(VecHeader) + sizeof(Value) * cap);
+	if (h == NULL) {
+		panic("out of memory");
+	}
+	h->heap = RT->heap;
+	h->used = vl.num_values;
+	h->cap = cap;
+
+	Value* values = (Value*)(h + 1);
+	if (vl_mapped(vl)) {
+		for (int i = 0; i < vl.num_values; i++) {
+			values[i] = vl_get(vl, i);
+		}
+	} else if (vl.num_values > 0) {
+		memcpy(values, vl.values, sizeof(Value) * vl.num_values);
+	}
+	return (ValueList){.values = values, .num_values = vl.num_values};
+}
+
+// give a list that starts its buffer room for cap values
+ValueList vl_realloc(ValueList vl, int cap) {
+	if (cap < 0) {
+		panic("list too long");
+	}
+	VecHeader* h = rt_realloc(vl_header(vl), sizeof(VecHeader) + sizeof(Value) * cap);
+	if (h == NULL) {
+		panic("out of memory");
+	}
+	h->cap = cap;
+	vl.values = (Value*)(h + 1);
+	return vl;
+}
+
+// vl with n more values at the end, for the caller to fill in
+ValueList vl_grow(ValueList vl, int n) {
+	if (vl.values != NULL && !vl_mapped(vl)) {
+		VecHeader* h = vl_header(vl);
+		int end = vl.start + vl.num_values;
+		if (end == h->used && h->cap - end >= n && h->heap == RT->heap) {
+			h->used += n;
+			vl.num_values += n;
+			return vl;
+		}
+	}
 
+	if (vl.num_values > INT_MAX / 2 - n) {
+		panic("list too long");
+	}
+	ValueList c = vl_copy(vl, (vl.num_values + n) * 2);
+	c.num_values += n;
+	vl_header(c)->used = c.num_values;
+	return c;
+}
+
+// add a value to a list that only the caller has
 #define vl_append(vl, ... ) \
 	do { \
-		vl_resize((vl), (vl).num_values + 1); \
+		rt_charge(1); \
+		if ((vl).values != NULL && vl_header(vl)->used == vl_header(vl)->cap) { \
+			(vl) = vl_realloc((vl), vl_header(vl)->cap * 2); \
+		} \
+		(vl) = vl_grow((vl), 1); \
 		(vl).values[(vl).num_values - 1] = (__VA_ARGS__); \
 	} while(0)
 
-typedef struct Value {
-	ValueType type;
-	union {
-		int int_value;
-		ValueList list_value;
-	};
-} Value;
-
 typedef Value E_Func(struct Expr*);
 
+// a block of ints for columnar evaluation, see eval_batch()
+typedef int VecInt __attribute__((vector_size(32)));
+
+// the column version of a builtin: out[i] = f(args[0][i], args[1][i], ...)
+// for n VecInts. false to have the block evaluated row by row instead
+typedef bool E_VecFunc(VecInt* out, VecInt** args, int n);
+
 // pass this to rt_func() to signify that the function takes a variable #
 // of arguments
 // RTFN = runtime function
@@ -313,7 +1127,7 @@ typedef Value E_Func(struct Expr*);
 
 /* 	associative type that holds the name and pointer to a function as well as
 	# of arguments */
-typedef struct {
+typedef struct E_FuncData {
 	// in (+ 2 3) name is "+"
 	char* name;
 	int name_len;
@@ -323,13 +1137,11 @@ typedef struct {
 	ValueType return_type;
 
 	E_Func* actual_function;
-} E_FuncData;
+	E_VecFunc* vec_function; // NULL if it has no column version
+	bool impure; // depends on more than its args, so never cached
 
-typedef struct {
-	E_FuncData func;
-	struct Expr** args;
-	int real_num_args; // THIS CANNOT BE -1
-} E_FuncCall;
+	struct Closure* closure; // only for lambdas, see e_func_apply_closure()
+} E_FuncData;
 
 Value e_func_add(struct Expr* e);
 Value e_func_sub(struct Expr* e);
@@ -351,8 +1163,29 @@ Value e_func_list(struct Expr* e);
 Value e_func_len(struct Expr* e);
 Value e_func_sum(struct Expr* e);
 Value e_func_range(struct Expr* e);
+Value e_func_min(struct Expr* e);
+Value e_func_max(struct Expr* e);
+Value e_func_map(struct Expr* e);
+Value e_func_filter(struct Expr* e);
+Value e_func_reduce(struct Expr* e);
+Value e_func_take(struct Expr* e);
+Value e_func_nth(struct Expr* e);
+Value e_func_slice(struct Expr* e);
+Value e_func_push(struct Expr* e);
+Value e_func_concat(struct Expr* e);
+Value e_func_load_ints(struct Expr* e);
+Value e_func_load_ints64(struct Expr* e);
+Value e_func_map_new(struct Expr* e);
+Value e_func_put(struct Expr* e);
+Value e_func_get(struct Expr* e);
+Value e_func_has(struct Expr* e);
+Value e_func_map_len(struct Expr* e);
+Value e_func_apply_closure(struct Expr* e);
+
+Value e_func_sq(struct Expr* e);
+Value e_func_odd(struct Expr* e);
+Value e_func_even(struct Expr* e);
 
-Value e_func_if(struct Expr* e);
 
 // list of functions defined in the runtime
 typedef struct {
@@ -388,28 +1221,201 @@ typedef struct {
 		rt_fnlist_resize(l, (l).num_fns - 1); \
 	} while(0)
 
-// list of functions available in the runtime
-// their argument count, argument types, return types are all specified in here
-RT_FnList RT_BUILTIN_FUNCTIONS = {0};
-
-typedef enum {
-	E_NONE,
-	E_INT,
-	E_IDENT,
-	E_FUNCCALL,
-} ExprType;
+// another associative type
+typedef struct {
+	char* name;
+	Value value;
+} VarData;
 
-typedef struct Expr {
-	ExprType type;
-	union {
-		int intlit;
-		E_Ident ident;
-		E_FuncCall funccall;
-	};
-} Expr;
+typedef struct {
+	VarData* vars;
+	int num_vars;	
+} RT_VarList;
 
-#define expr_new() \
-	(calloc(1, sizeof(Expr)))
+#define rt_varlist_new() \
+	((RT_VarList){0})
+
+#define rt_varlist_resize(l, n) \
+	do { \
+		(l).num_vars = (n); \
+		(l).vars = realloc((l).vars, sizeof(VarData) * (l).num_vars); \
+	} while(0)
+
+#define rt_varlist_append(l, ...) \
+	do { \
+		rt_varlist_resize(l, (l).num_vars + 1); \
+		(l).vars[(l).num_vars - 1] = (VarData)__VA_ARGS__; \
+	} while(0)
+
+#define rt_varlist_swap(l, i, j) \
+	do { \
+		VarData temp = (l).vars[(i)]; \
+		(l).vars[(i)] = (l).vars[(j)]; \
+		(l).vars[(j)] = temp; \
+	} while(0)
+
+#define rt_varlist_remove(l, index) \
+	do { \
+		rt_fnlist_swap(l, index, (l).num_vars - 1); \
+		rt_fnlist_resize(l, (l).num_vars - 1); \
+	} while(0)
+
+struct ThreadPool;
+struct Cache;
+
+struct lisp_ctx {
+	// list of functions available in the runtime
+	// their argument count, argument types, return types are all specified in here
+	RT_FnList builtins;
+	RT_VarList constants;
+	E_VecFunc* vec_if; // the column version of if, see eval_batch()
+
+	// dlopen() handles of the plugins that added builtins
+	void** plugins;
+	int num_plugins;
+
+	// programs refer to builtins by index, so once one is compiled no
+	// more can be added, see lisp_add_builtin()
+	bool compiled;
+
+	// false to always materialize intermediate lists (see Seq)
+	bool fuse;
+
+	// see reduce_arg()
+	int num_threads;
+	int par_threshold;
+	struct ThreadPool* pool; // started on first use
+
+	Trace* trace; // see lisp_set_trace()
+
+	lisp_budget budget; // for each lisp_eval(), see budget_check()
+
+	struct Cache* cache; // NULL unless set, see lisp_eval_source()
+	struct lisp_prog* last_prog; // uncached program of lisp_eval_source()
+
+	// values produced by the last lisp_eval(), and the files they map
+	Heap eval_heap;
+	struct Mapping* mappings;
+	pthread_mutex_t mappings_lock; // load-ints may run on the thread pool
+
+	// value and frame stacks for eval(), kept between evaluations
+	Value* stack;
+	struct Frame* frames;
+
+	RT_State state;
+	char error[RT_ERROR_MAX];
+};
+
+struct lisp_prog {
+	Heap heap; // the source, Exprs and everything they point to
+	struct Expr* expr; // the root, the last node of the program
+	int num_params; // highest $n it uses + 1
+};
+
+/*	variables: let, define and the top level of a program each open a
+	scope. parse() resolves every variable to the number of scopes up from
+	where it is used (depth) and its index in that scope (slot), and at
+	runtime each scope is a Frame with one Value per slot, so reading a
+	variable never compares names */
+
+// parse time
+typedef struct Scope {
+	E_Ident* names; // index = slot
+	int num_names;
+	struct Scope* up;
+
+	bool is_lambda;
+	bool captured;
+} Scope;
+
+// run time
+typedef struct Frame {
+	Value* slots;
+	struct Frame* up;
+} Frame;
+
+typedef struct {
+	E_Ident name;
+	int depth;
+	int slot;
+} E_Var;
+
+// (define name value), always in the innermost scope. the value is the
+// only child
+typedef struct {
+	E_Ident name;
+	int slot;
+} E_Define;
+
+// a body of expressions (the children) evaluated in a new Frame, returns
+// the last one
+typedef struct {
+	int num_slots;
+} E_Scope;
+
+// (lambda (params ...) body ...), the children are the body and the
+// params are the first slots of its Frame
+typedef struct {
+	char* name; // "lambda", or the name given to defun
+	int num_params;
+	int num_slots;
+} E_Lambda;
+
+// a function value created by evaluating an E_LAMBDA
+typedef struct Closure {
+	E_FuncData func; // .closure points back here
+	struct Expr* lambda;
+	struct Frame* env;
+} Closure;
+
+typedef enum {
+	E_NONE,
+	E_INT,
+	E_FUNCCALL, // a builtin, the children are its args
+	E_APPLY, // any function value with already built args, see FuncApply
+	E_VALUE, // an already evaluated value, eg. a builtin passed by name
+	E_VAR,
+	E_PARAM, // $0, $1, ... bound by lisp_eval_params() or lisp_eval_batch()
+	E_STRING, // a "string literal", only read by the builtins that take one
+	E_DEFINE,
+	E_SCOPE,
+	E_LAMBDA,
+	E_IF, // the children are cond, then and else
+	E_CALL, // a call to a function value, eg. (f x) where f is a variable.
+		// the children are the function and then the args
+} ExprType;
+
+/*	a compiled program is a single array of Exprs. the children of a node
+	are next to each other, somewhere before the node itself, so instead of
+	pointers a node only keeps how many nodes back its first child is. the
+	root is the last node. E_FUNCCALL names its builtin by its index in
+	ctx->builtins instead of carrying a copy of the E_FuncData */
+typedef struct Expr {
+	uint8_t type; // ExprType
+	bool captured; // E_SCOPE/E_LAMBDA: a closure refers to one of the slots
+	uint16_t fn; // E_FUNCCALL
+	uint32_t num_kids;
+	uint32_t kids;
+	union {
+		int intlit;
+		int param; // E_PARAM
+		E_Ident str; // E_STRING, without the quotes
+		Value value;
+		E_Var var;
+		E_Define define;
+		E_Scope scope;
+		E_Lambda lambda;
+		E_FuncData* func; // E_APPLY
+	};
+} Expr;
+
+// child i of e, eg. argument i of a call
+#define expr_arg(e, i) \
+	((e) - (e)->kids + (i))
+
+// the function an E_FUNCCALL or E_APPLY calls
+#define expr_func(e) \
+	((e)->type == E_FUNCCALL ? &RT->builtins[(e)->fn] : (e)->func)
 
 #define expr_print(e) \
 	do { \
@@ -420,30 +1426,50 @@ typedef struct Expr {
 void expr_print_rec(Expr* e) {
 	if (e->type == E_INT) {
 		printf("(int %d)", e->intlit);
-	} else if (e->type == E_FUNCCALL) {
-		printf("(%.*s ",
-			e->funccall.func.name_len,
-			e->funccall.func.name);
-
-		for (int i = 0; i < e->funccall.real_num_args; i++) {
-			expr_print_rec(e->funccall.args[i]);
-
-			if (i != e->funccall.real_num_args - 1) {
+	} else if (e->type == E_FUNCCALL || e->type == E_APPLY) {
+		printf("(%.*s", expr_func(e)->name_len, expr_func(e)->name);
+		for (uint32_t i = 0; i < e->num_kids; i++) {
+			putc(' ', stdout);
+			expr_print_rec(expr_arg(e, i));
+		}
+		putc(')', stdout);
+	} else if (e->type == E_VAR) {
+		printf("%.*s", e->var.name.len, e->var.name.name);
+	} else if (e->type == E_PARAM) {
+		printf("$%d", e->param);
+	} else if (e->type == E_STRING) {
+		printf("\"%.*s\"", e->str.len, e->str.name);
+	} else if (e->type == E_DEFINE) {
+		printf("(define %.*s ", e->define.name.len, e->define.name.name);
+		expr_print_rec(expr_arg(e, 0));
+		putc(')', stdout);
+	} else if (e->type == E_SCOPE || e->type == E_LAMBDA || e->type == E_IF || e->type == E_CALL) {
+		if (e->type == E_SCOPE) {
+			printf("(scope ");
+		} else if (e->type == E_LAMBDA) {
+			printf("(lambda %d ", e->lambda.num_params);
+		} else if (e->type == E_IF) {
+			printf("(if ");
+		} else {
+			putc('(', stdout);
+		}
+		for (uint32_t i = 0; i < e->num_kids; i++) {
+			if (i > 0) {
 				putc(' ', stdout);
 			}
-
+			expr_print_rec(expr_arg(e, i));
 		}
-
 		putc(')', stdout);
-
-	} else if (e->type == E_IDENT) {
-		printf("%.*s", e->ident.len, e->ident.name);
+	} else if (e->type == E_VALUE && e->value.type == V_FUNC) {
+		printf("%s", e->value.func_value->name);
+	} else if (e->type == E_VALUE && e->value.type == V_INT) {
+		printf("(int %d)", e->value.int_value);
 	} else {
 		putc('?', stdout);
 	}
 }
 
-Expr* parse(ASTNode* ast);
+Expr parse(ASTNode* ast);
 
 // ast_matches_*** should not write to out unless it will also return true
 
@@ -467,242 +1493,599 @@ bool ast_matches_intlit(ASTNode* ast, int* out) {
 	return true;
 }
 
-bool ast_matches_ident(ASTNode* ast, E_Ident* out) {
-	if (ast->type != A_ATOM) {
+// $n, an input of the program
+bool ast_matches_param(ASTNode* ast, int* out) {
+	if (ast->type != A_ATOM
+	|| ast->atom_len < 2
+	|| ast->atom_str[0] != '$'
+	|| !isdigit(ast->atom_str[1])) {
+		return false;
+	}
+
+	char* end;
+	long n = strtol(ast->atom_str + 1, &end, 10);
+	if (end != ast->atom_str + ast->atom_len) {
 		return false;
 	}
+	if (n > UINT16_MAX) {
+		panic("$%ld: too many parameters", n);
+	}
 
-	out->name = ast->atom_str;
-	out->len = ast->atom_len;
+	if (n + 1 > RT->params_used) {
+		RT->params_used = n + 1;
+	}
+	*out = n;
 	return true;
 }
 
-bool ast_matches_funccall(ASTNode* ast, E_FuncCall* out) {
-	if (ast->type != A_LIST
-	|| ast->list_len == 0
-	|| ast->list_items[0]->type != A_ATOM) {
+// "text", which can't contain a quote
+bool ast_matches_string(ASTNode* ast, E_Ident* out) {
+	if (ast->type != A_ATOM || ast->atom_str[0] != '"') {
 		return false;
 	}
 
-	for (int i = 0; i < RT_BUILTIN_FUNCTIONS.num_fns; i++) {
-		E_FuncData* fd = &RT_BUILTIN_FUNCTIONS.fns[i];
+	if (ast->atom_len < 2
+	|| ast->atom_str[ast->atom_len - 1] != '"'
+	|| memchr(ast->atom_str + 1, '"', ast->atom_len - 2) != NULL) {
+		panic("parse error: bad string %.*s", ast->atom_len, ast->atom_str);
+	}
 
-		if (strncmp(
-			ast->list_items[0]->atom_str,
-			fd->name,
-			fd->name_len) != 0)
-		{
-			continue;
+	*out = (E_Ident){.name = ast->atom_str + 1, .len = ast->atom_len - 2};
+	return true;
+}
+
+// exact match on the name, so "<" does not also match "<="
+E_FuncData* rt_find_func(char* name, int len) {
+	RT_FnList* fns = &RT->ctx->builtins;
+	for (int i = 0; i < fns->num_fns; i++) {
+		E_FuncData* fd = &fns->fns[i];
+		if (fd->name_len == len && !strncmp(name, fd->name, len)) {
+			return fd;
 		}
+	}
+	return NULL;
+}
 
-		// at this point, function name matches
+// a builtin used as a value, eg. (map sq l)
+bool ast_matches_funcref(ASTNode* ast, Value* out) {
+	if (ast->type != A_ATOM) {
+		return false;
+	}
 
-		int real_num_args;
+	E_FuncData* fd = rt_find_func(ast->atom_str, ast->atom_len);
+	if (fd == NULL) {
+		return false;
+	}
 
-		if (fd->num_args != -1) {
-			real_num_args = fd->num_args;
-		} else {
-			real_num_args = ast->list_len - 1;
-		}
+	*out = (Value){.type = V_FUNC, .func_value = fd};
+	return true;
+}
 
-		if (real_num_args != ast->list_len - 1) {
-			panic("%.*s: expected %d arguments, got %d",
-				ast->list_items[0]->atom_len,
-				ast->list_items[0]->atom_str,
-				real_num_args,
-				ast->list_len - 1);
-		}
+// a name that starts with '#'
+bool ast_matches_constant(ASTNode* ast, Value* out) {
+	if (ast->type != A_ATOM || ast->atom_str[0] != '#') {
+		return false;
+	}
 
-		out->func = *fd;
-		out->real_num_args = real_num_args;
-		out->args = malloc(real_num_args * sizeof(Expr*));
-		
-		for (int i = 0; i < real_num_args; i++) {
-			out->args[i] = parse(ast->list_items[i + 1]);
+	RT_VarList* constants = &RT->ctx->constants;
+	for (int i = 0; i < constants->num_vars; i++) {
+		VarData* vd = &constants->vars[i];
+		if (!strncmp(
+			vd->name,
+			ast->atom_str,
+			ast->atom_len)
+		&& vd->name[ast->atom_len] == '\0')
+		{
+			// names match
+			*out = vd->value;
+			return true;
 		}
-
-		return true;
 	}
-
-	panic("unknown function \"%.*s\"",
-		ast->list_items[0]->atom_len,
-		ast->list_items[0]->atom_str);
+	panic("unknown constant %.*s", ast->atom_len, ast->atom_str);
 }
 
-Expr* parse(ASTNode* ast) {
+#define ident_eq(a, b) \
+	((a).len == (b).len && !strncmp((a).name, (b).name, (a).len))
 
-	Expr* e = expr_new();
+// add a name to the innermost scope, or find it if it's already there
+int scope_declare(E_Ident name) {
+	Scope* sc = RT->scope;
 
-	if (ast == NULL) {
-		panic("parse: ast is null");
+	for (int i = 0; i < sc->num_names; i++) {
+		if (ident_eq(sc->names[i], name)) {
+			return i;
+		}
 	}
 
-	if (ast_matches_intlit(ast, &e->intlit)) {
-		e->type = E_INT;
-		return e;
-	}
-	
-	if (ast_matches_ident(ast, &e->ident)) {
-		e->type = E_IDENT;
-		return e;
+	sc->num_names++;
+	sc->names = rt_realloc(sc->names, sizeof(E_Ident) * sc->num_names);
+	sc->names[sc->num_names - 1] = name;
+	return sc->num_names - 1;
+}
+
+bool ast_matches_var(ASTNode* ast, E_Var* out) {
+	if (ast->type != A_ATOM) {
+		return false;
 	}
 
-	if (ast_matches_funccall(ast, &e->funccall)) {
-		e->type = E_FUNCCALL;
-		return e;
+	E_Ident name = {.name = ast->atom_str, .len = ast->atom_len};
+
+	// the scope just outside the innermost lambda, if any
+	Scope* closure_env = NULL;
+
+	int depth = 0;
+	for (Scope* sc = RT->scope; sc != NULL; sc = sc->up, depth++) {
+		// later definitions shadow earlier ones
+		for (int i = sc->num_names - 1; i >= 0; i--) {
+			if (ident_eq(sc->names[i], name)) {
+				// a closure reaches this slot by walking up from the frame
+				// it was created in, so all of those frames have to stay
+				// alive as long as the closure does
+				if (closure_env != NULL) {
+					for (Scope* c = closure_env; c != sc->up; c = c->up) {
+						c->captured = true;
+					}
+				}
+				*out = (E_Var){.name = name, .depth = depth, .slot = i};
+				return true;
+			}
+		}
+		if (sc->is_lambda && closure_env == NULL) {
+			closure_env = sc->up;
+		}
 	}
 
-	panic("parse: could not match expr");
+	return false;
 }
 
-Value eval(Expr* e);
-
-char* stringify_value_type(ValueType type) {
-	switch (type) {
-		case V_NONE: return "none";
-		case V_INT: return "int";
-		case V_LIST: return "list of int";
-	}
+// (name ...) where name is one of the special forms below
+bool ast_is_form(ASTNode* ast, char* name) {
+	return ast->type == A_LIST
+		&& ast->list_len > 0
+		&& ast->list_items[0]->type == A_ATOM
+		&& ast->list_items[0]->atom_len == (int)strlen(name)
+		&& !strncmp(ast->list_items[0]->atom_str, name, strlen(name));
 }
 
-// called outside of each e_func_***
-void assert_funccall_arg_count_correct(Expr* e) {
-	if (e->funccall.func.num_args == -1
-	|| e->funccall.func.num_args == e->funccall.real_num_args) {
-		return;
+// add n nodes to the program as one block of children and return the
+// index of the first one. layout_kids() turns the indices in kids into
+// offsets once the whole program is there
+uint32_t emit_kids(Expr* kids, int n) {
+	if (RT->num_nodes + n > RT->nodes_cap) {
+		while (RT->num_nodes + n > RT->nodes_cap) {
+			RT->nodes_cap = RT->nodes_cap ? RT->nodes_cap * 2 : 64;
+		}
+		RT->nodes = rt_realloc(RT->nodes, sizeof(Expr) * RT->nodes_cap);
+		if (RT->nodes == NULL) {
+			panic("out of memory");
+		}
 	}
 
-	panic("%.*s, got %d arguments, expected %d",
-		e->funccall.func.name_len,
-		e->funccall.func.name,
-		e->funccall.real_num_args,
-		e->funccall.func.num_args);
+	memcpy(&RT->nodes[RT->num_nodes], kids, sizeof(Expr) * n);
+	RT->num_nodes += n;
+	return RT->num_nodes - n;
 }
 
-// called inside each e_func_***, once per argument
-Value try_eval_arg_as_type(Expr* e, int arg_num, ValueType type) {
+// parse items (after the prelude nodes, if any) into the children of out
+void parse_kids(Expr* out, Expr* prelude, int prelude_len, ASTNode** items, int num_items) {
 
-	E_FuncData fd = e->funccall.func;
-	Value v = eval(e->funccall.args[arg_num]);
-	if (v.type != type) {
-		panic("%.*s: argument %d is type %s, expected %s",
-			fd.name_len,
-			fd.name,
-			arg_num,
-			stringify_value_type(v.type),
-			stringify_value_type(type));
+	int n = prelude_len + num_items;
+	Expr* kids = rt_calloc(sizeof(Expr) * (n + 1));
+
+	for (int i = 0; i < prelude_len; i++) {
+		kids[i] = prelude[i];
+	}
+	for (int i = 0; i < num_items; i++) {
+		kids[prelude_len + i] = parse(items[i]);
 	}
 
-	return v;
+	out->num_kids = n;
+	out->kids = emit_kids(kids, n);
+	rt_free(kids);
 }
 
-// (+ (int n1) (int n2))
-Value e_func_add(Expr* e) {
-
-	Value arg0 = try_eval_arg_as_type(e, 0, V_INT);
-	Value arg1 = try_eval_arg_as_type(e, 1, V_INT);
+// (define name value)
+bool ast_matches_define(ASTNode* ast, Expr* out) {
+	if (!ast_is_form(ast, "define")) {
+		return false;
+	}
 
-	int n0 = arg0.int_value;
-	int n1 = arg1.int_value;
+	if (ast->list_len != 3 || ast->list_items[1]->type != A_ATOM) {
+		panic("define: expected (define name value)");
+	}
 
-	return (Value){
-		.type = V_INT,
-		.int_value = n0 + n1
+	out->define.name = (E_Ident){
+		.name = ast->list_items[1]->atom_str,
+		.len = ast->list_items[1]->atom_len
 	};
+	// declared first so the value can refer to it
+	out->define.slot = scope_declare(out->define.name);
+	parse_kids(out, NULL, 0, ast->list_items + 2, 1);
+	return true;
 }
 
-// (- (int n1) (int n2))
-Value e_func_sub(Expr* e) {
-
-	Value arg0 = try_eval_arg_as_type(e, 0, V_INT);
-	Value arg1 = try_eval_arg_as_type(e, 1, V_INT);
+// parse a body in a new scope, with the defines in prelude (if any) first.
+// returns the number of slots its Frame needs
+int parse_scope(Expr* out, Expr* prelude, int prelude_len, ASTNode** items, int num_items) {
+
+	// functions can call ones defined after them in the same body
+	for (int i = 0; i < num_items; i++) {
+		if (ast_is_form(items[i], "defun")
+		&& items[i]->list_len > 1
+		&& items[i]->list_items[1]->type == A_ATOM) {
+			scope_declare((E_Ident){
+				.name = items[i]->list_items[1]->atom_str,
+				.len = items[i]->list_items[1]->atom_len
+			});
+		}
+	}
 
-	int n0 = arg0.int_value;
-	int n1 = arg1.int_value;
+	parse_kids(out, prelude, prelude_len, items, num_items);
 
-	return (Value){
-		.type = V_INT,
-		.int_value = n0 - n1
-	};
+	out->captured = RT->scope->captured;
+	return RT->scope->num_names;
 }
 
-// (* (int n1) (int n2))
-Value e_func_mul(Expr* e) {
+// (let ((name value) ...) body ...)
+// each value can see the names bound before it, like let* in scheme
+bool ast_matches_let(ASTNode* ast, Expr* out) {
+	if (!ast_is_form(ast, "let")) {
+		return false;
+	}
 
-	Value arg0 = try_eval_arg_as_type(e, 0, V_INT);
-	Value arg1 = try_eval_arg_as_type(e, 1, V_INT);
+	if (ast->list_len < 2 || ast->list_items[1]->type != A_LIST) {
+		panic("let: expected (let ((name value) ...) body ...)");
+	}
 
-	int n0 = arg0.int_value;
-	int n1 = arg1.int_value;
+	ASTNode* bindings = ast->list_items[1];
+	if (bindings->list_len == 0 && ast->list_len == 2) {
+		panic("let: expected (let ((name value) ...) body ...)");
+	}
 
-	return (Value){
-		.type = V_INT,
-		.int_value = n0 * n1
-	};
-}
+	Expr* defines = rt_calloc(sizeof(Expr) * (bindings->list_len + 1));
 
-// (% (int n1) (int n2))
-Value e_func_mod(Expr* e) {
+	Scope sc = {.up = RT->scope};
+	RT->scope = &sc;
 
-	Value arg0 = try_eval_arg_as_type(e, 0, V_INT);
-	Value arg1 = try_eval_arg_as_type(e, 1, V_INT);
+	for (int i = 0; i < bindings->list_len; i++) {
+		ASTNode* b = bindings->list_items[i];
+		if (b->type != A_LIST || b->list_len != 2 || b->list_items[0]->type != A_ATOM) {
+			panic("let: expected (name value) in bindings");
+		}
 
-	int n0 = arg0.int_value;
-	int n1 = arg1.int_value;
+		Expr* d = &defines[i];
+		d->type = E_DEFINE;
+		d->define.name = (E_Ident){
+			.name = b->list_items[0]->atom_str,
+			.len = b->list_items[0]->atom_len
+		};
+		// unlike define, the name isn't visible in its own value
+		parse_kids(d, NULL, 0, b->list_items + 1, 1);
+		d->define.slot = scope_declare(d->define.name);
+	}
 
-	return (Value){
-		.type = V_INT,
-		.int_value = n0 % n1
-	};
+	out->scope.num_slots = parse_scope(out, defines, bindings->list_len,
+		ast->list_items + 2, ast->list_len - 2);
+
+	rt_free(defines);
+	rt_free(sc.names);
+	RT->scope = sc.up;
+	return true;
 }
 
-// (= n1 n2)
-Value e_func_eq(struct Expr* e) {
+// lambda/defun without the name: ((params ...) body ...)
+void parse_lambda(Expr* out, char* name, ASTNode** items, int num_items) {
 
-	Value arg0 = try_eval_arg_as_type(e, 0, V_INT);
-	Value arg1 = try_eval_arg_as_type(e, 1, V_INT);
+	if (num_items < 2 || items[0]->type != A_LIST) {
+		panic("%s: expected (params ...) and a body", name);
+	}
 
-	int n0 = arg0.int_value;
-	int n1 = arg1.int_value;
+	ASTNode* params = items[0];
 
-	return (Value){
-		.type = V_INT,
-		.int_value = n0 == n1
-	};
-}
+	Scope sc = {.up = RT->scope, .is_lambda = true};
+	RT->scope = &sc;
 
-// (!= n1 n2)
-Value e_func_neq(struct Expr* e) {
+	for (int i = 0; i < params->list_len; i++) {
+		ASTNode* param = params->list_items[i];
+		if (param->type != A_ATOM) {
+			panic("%s: parameters must be names", name);
+		}
+		scope_declare((E_Ident){.name = param->atom_str, .len = param->atom_len});
+	}
 
-	Value arg0 = try_eval_arg_as_type(e, 0, V_INT);
-	Value arg1 = try_eval_arg_as_type(e, 1, V_INT);
+	if (sc.num_names != params->list_len) {
+		panic("%s: duplicate parameter name", name);
+	}
 
-	int n0 = arg0.int_value;
-	int n1 = arg1.int_value;
+	out->lambda.name = name;
+	out->lambda.num_params = params->list_len;
+	out->lambda.num_slots = parse_scope(out, NULL, 0, items + 1, num_items - 1);
 
-	return (Value){
-		.type = V_INT,
-		.int_value = n0 != n1
-	};
+	rt_free(sc.names);
+	RT->scope = sc.up;
 }
 
-// (< n1 n2)
-Value e_func_lt(struct Expr* e) {
+// (lambda (params ...) body ...)
+bool ast_matches_lambda(ASTNode* ast, Expr* out) {
+	if (!ast_is_form(ast, "lambda")) {
+		return false;
+	}
 
-	Value arg0 = try_eval_arg_as_type(e, 0, V_INT);
-	Value arg1 = try_eval_arg_as_type(e, 1, V_INT);
+	parse_lambda(out, "lambda", ast->list_items + 1, ast->list_len - 1);
+	return true;
+}
 
-	int n0 = arg0.int_value;
-	int n1 = arg1.int_value;
+// (defun name (params ...) body ...) is (define name (lambda ...))
+bool ast_matches_defun(ASTNode* ast, Expr* out) {
+	if (!ast_is_form(ast, "defun")) {
+		return false;
+	}
 
-	return (Value){
-		.type = V_INT,
-		.int_value = n0 < n1
+	if (ast->list_len < 4 || ast->list_items[1]->type != A_ATOM) {
+		panic("defun: expected (defun name (params ...) body ...)");
+	}
+
+	E_Ident ident = {
+		.name = ast->list_items[1]->atom_str,
+		.len = ast->list_items[1]->atom_len
 	};
-}
+	out->define.name = ident;
+	out->define.slot = scope_declare(ident);
 
-// (> n1 n2)
-Value e_func_gt(struct Expr* e) {
+	// error messages print the name with %s
+	char* name = rt_alloc(ident.len + 1);
+	memcpy(name, ident.name, ident.len);
+	name[ident.len] = '\0';
+
+	Expr lambda = {.type = E_LAMBDA};
+	parse_lambda(&lambda, name, ast->list_items + 2, ast->list_len - 2);
+
+	out->num_kids = 1;
+	out->kids = emit_kids(&lambda, 1);
+	return true;
+}
+
+// (if cond then else)
+bool ast_matches_if(ASTNode* ast, Expr* out) {
+	if (!ast_is_form(ast, "if")) {
+		return false;
+	}
+
+	if (ast->list_len != 4) {
+		panic("if: expected 3 arguments, got %d", ast->list_len - 1);
+	}
+
+	parse_kids(out, NULL, 0, ast->list_items + 1, 3);
+	return true;
+}
+
+// (f args ...) where f is not the name of a builtin
+bool ast_matches_call(ASTNode* ast, Expr* out) {
+	if (ast->type != A_LIST || ast->list_len == 0) {
+		return false;
+	}
+
+	ASTNode* head = ast->list_items[0];
+	E_Var var;
+
+	// variables shadow builtins of the same name
+	if (head->type == A_ATOM && !ast_matches_var(head, &var)) {
+		return false;
+	}
+
+	parse_kids(out, NULL, 0, ast->list_items, ast->list_len);
+	return true;
+}
+
+/*	parse() emits each block of children after everything below them, in
+	the order it parses them. the final array has the blocks in reverse
+	pre-order instead: the root last, its children right before it, the
+	children of its first child before those, and so on. eval() then moves
+	through memory from the end to the front, one block after the other */
+
+// copy the children of to[at] and everything below them from the parse
+// order array into to, ending just before *next
+void layout_kids(Expr* from, Expr* to, int at, int* next) {
+	Expr* e = &to[at];
+	if (e->num_kids == 0) {
+		return;
+	}
+
+	*next -= e->num_kids;
+	int start = *next;
+	memcpy(&to[start], &from[e->kids], sizeof(Expr) * e->num_kids);
+	e->kids = at - start;
+
+	for (uint32_t i = 0; i < e->num_kids; i++) {
+		layout_kids(from, to, start + i, next);
+	}
+}
+
+// the whole program, the top level is a scope of its own
+Expr* parse_program(ASTNode* forms) {
+
+	Scope sc = {0};
+	RT->scope = &sc;
+	RT->nodes = NULL;
+	RT->num_nodes = 0;
+	RT->nodes_cap = 0;
+
+	Expr root = {.type = E_SCOPE};
+	root.scope.num_slots = parse_scope(&root, NULL, 0, forms->list_items, forms->list_len);
+	emit_kids(&root, 1);
+
+	int n = RT->num_nodes;
+	Expr* nodes = rt_alloc(sizeof(Expr) * n);
+	if (nodes == NULL) {
+		panic("out of memory");
+	}
+	nodes[n - 1] = root;
+	int next = n - 1;
+	layout_kids(RT->nodes, nodes, n - 1, &next);
+
+	rt_free(RT->nodes);
+	RT->nodes = NULL;
+	rt_free(sc.names);
+	RT->scope = NULL;
+	return &nodes[n - 1];
+}
+
+bool ast_matches_funccall(ASTNode* ast, Expr* out) {
+	if (ast->type != A_LIST
+	|| ast->list_len == 0
+	|| ast->list_items[0]->type != A_ATOM) {
+		return false;
+	}
+
+	E_FuncData* fd = rt_find_func(
+		ast->list_items[0]->atom_str,
+		ast->list_items[0]->atom_len);
+
+	if (fd == NULL) {
+		panic("unknown function \"%.*s\"",
+			ast->list_items[0]->atom_len,
+			ast->list_items[0]->atom_str);
+	}
+
+	int real_num_args;
+
+	if (fd->num_args != -1) {
+		real_num_args = fd->num_args;
+	} else {
+		real_num_args = ast->list_len - 1;
+	}
+
+	if (real_num_args != ast->list_len - 1) {
+		panic("%.*s: expected %d arguments, got %d",
+			ast->list_items[0]->atom_len,
+			ast->list_items[0]->atom_str,
+			real_num_args,
+			ast->list_len - 1);
+	}
+
+	int index = fd - RT->ctx->builtins.fns;
+	if (index > UINT16_MAX) {
+		panic("%s: too many builtins", fd->name);
+	}
+
+	out->fn = index;
+	parse_kids(out, NULL, 0, ast->list_items + 1, real_num_args);
+	return true;
+}
+
+Expr parse(ASTNode* ast) {
+
+	Expr e = {0};
+
+	if (ast == NULL) {
+		panic("parse: ast is null");
+	}
+
+	if (ast_matches_intlit(ast, &e.intlit)) {
+		e.type = E_INT;
+		return e;
+	}
+
+	if (ast_matches_param(ast, &e.param)) {
+		e.type = E_PARAM;
+		return e;
+	}
+
+	if (ast_matches_string(ast, &e.str)) {
+		e.type = E_STRING;
+		return e;
+	}
+	
+	if (ast_matches_constant(ast, &e.value)) {
+		e.type = E_VALUE;
+		return e;
+	}
+
+	// variables shadow builtins of the same name
+	if (ast_matches_var(ast, &e.var)) {
+		e.type = E_VAR;
+		return e;
+	}
+
+	if (ast_matches_funcref(ast, &e.value)) {
+		e.type = E_VALUE;
+		return e;
+	}
+
+	if (ast->type == A_ATOM) {
+		panic("unknown variable %.*s", ast->atom_len, ast->atom_str);
+	}
+
+	if (ast_matches_define(ast, &e)) {
+		e.type = E_DEFINE;
+		return e;
+	}
+
+	if (ast_matches_let(ast, &e)) {
+		e.type = E_SCOPE;
+		return e;
+	}
+
+	if (ast_matches_lambda(ast, &e)) {
+		e.type = E_LAMBDA;
+		return e;
+	}
+
+	if (ast_matches_defun(ast, &e)) {
+		e.type = E_DEFINE;
+		return e;
+	}
+
+	if (ast_matches_if(ast, &e)) {
+		e.type = E_IF;
+		return e;
+	}
+
+	if (ast_matches_call(ast, &e)) {
+		e.type = E_CALL;
+		return e;
+	}
+
+	if (ast_matches_funccall(ast, &e)) {
+		e.type = E_FUNCCALL;
+		return e;
+	}
+
+	panic("parse: could not match expr");
+}
+
+Value eval(Expr* e);
+
+char* stringify_value_type(ValueType type) {
+	switch (type) {
+		case V_NONE: return "none";
+		case V_INT: return "int";
+		case V_LIST: return "list of int";
+		case V_FUNC: return "function";
+		case V_MAP: return "map";
+	}
+	return "?";
+}
+
+// called inside each e_func_***, once per argument
+Value try_eval_arg_as_type(Expr* e, int arg_num, ValueType type) {
+
+	Value v = eval(expr_arg(e, arg_num));
+	if (v.type != type) {
+		E_FuncData* fd = expr_func(e);
+		panic("%.*s: argument %d is type %s, expected %s",
+			fd->name_len,
+			fd->name,
+			arg_num,
+			stringify_value_type(v.type),
+			stringify_value_type(type));
+	}
+
+	return v;
+}
+
+// (+ (int n1) (int n2))
+Value e_func_add(Expr* e) {
 
 	Value arg0 = try_eval_arg_as_type(e, 0, V_INT);
 	Value arg1 = try_eval_arg_as_type(e, 1, V_INT);
@@ -712,12 +2095,12 @@ Value e_func_gt(struct Expr* e) {
 
 	return (Value){
 		.type = V_INT,
-		.int_value = n0 > n1
+		.int_value = n0 + n1
 	};
 }
 
-// (<= n1 n2)
-Value e_func_le(struct Expr* e) {
+// (- (int n1) (int n2))
+Value e_func_sub(Expr* e) {
 
 	Value arg0 = try_eval_arg_as_type(e, 0, V_INT);
 	Value arg1 = try_eval_arg_as_type(e, 1, V_INT);
@@ -727,12 +2110,12 @@ Value e_func_le(struct Expr* e) {
 
 	return (Value){
 		.type = V_INT,
-		.int_value = n0 <= n1
+		.int_value = n0 - n1
 	};
 }
 
-// (>= n1 n2)
-Value e_func_ge(struct Expr* e) {
+// (* (int n1) (int n2))
+Value e_func_mul(Expr* e) {
 
 	Value arg0 = try_eval_arg_as_type(e, 0, V_INT);
 	Value arg1 = try_eval_arg_as_type(e, 1, V_INT);
@@ -742,355 +2125,3931 @@ Value e_func_ge(struct Expr* e) {
 
 	return (Value){
 		.type = V_INT,
-		.int_value = n0 >= n1
+		.int_value = n0 * n1
 	};
 }
 
-// (bool (int x))
-Value e_func_bool(struct Expr* e) {
+// (% (int n1) (int n2))
+Value e_func_mod(Expr* e) {
 
 	Value arg0 = try_eval_arg_as_type(e, 0, V_INT);
+	Value arg1 = try_eval_arg_as_type(e, 1, V_INT);
 
 	int n0 = arg0.int_value;
+	int n1 = arg1.int_value;
+
+	// both trap in C. INT_MIN % -1 would overflow, but is 0 like any n % -1
+	if (n1 == 0) {
+		panic("%%: division by zero");
+	}
 
 	return (Value){
 		.type = V_INT,
-		.int_value = !!n0
+		.int_value = n1 == -1 ? 0 : n0 % n1
 	};
 }
 
-size_t e_func_fib_r(size_t n) {
-	if (n < 2)
-		return 1;
-	else
-		return e_func_fib_r(n-1) + e_func_fib_r(n-2);
-}
-
-// (fib n)
-Value e_func_fib(struct Expr* e) {
+// (= n1 n2)
+Value e_func_eq(struct Expr* e) {
 
 	Value arg0 = try_eval_arg_as_type(e, 0, V_INT);
+	Value arg1 = try_eval_arg_as_type(e, 1, V_INT);
 
-	int n = arg0.int_value;
+	int n0 = arg0.int_value;
+	int n1 = arg1.int_value;
 
 	return (Value){
 		.type = V_INT,
-		.int_value = e_func_fib_r(n)
+		.int_value = n0 == n1
 	};
 }
 
-// (list (int n0) (int n1) ...)
-Value e_func_list(struct Expr* e) {
+// (!= n1 n2)
+Value e_func_neq(struct Expr* e) {
 
-	ValueList result = vl_new();
+	Value arg0 = try_eval_arg_as_type(e, 0, V_INT);
+	Value arg1 = try_eval_arg_as_type(e, 1, V_INT);
 
-	// empty list
-	if (e->funccall.real_num_args == 0) {
-		return (Value){
-			.type = V_LIST,
-			.list_value = result
-		};
-	}
+	int n0 = arg0.int_value;
+	int n1 = arg1.int_value;
 
-	for (int i = 0; i < e->funccall.real_num_args; i++) {
-		Value list_item = try_eval_arg_as_type(e, i, V_INT);
-		vl_append(result, list_item);
-	}
-	
 	return (Value){
-		.type = V_LIST,
-		.list_value = result
+		.type = V_INT,
+		.int_value = n0 != n1
 	};
 }
 
-// (len (list l))
-Value e_func_len(struct Expr* e) {
+// (< n1 n2)
+Value e_func_lt(struct Expr* e) {
 
-	Value arg0 = try_eval_arg_as_type(e, 0, V_LIST);
+	Value arg0 = try_eval_arg_as_type(e, 0, V_INT);
+	Value arg1 = try_eval_arg_as_type(e, 1, V_INT);
 
-	int result = arg0.list_value.num_values;
+	int n0 = arg0.int_value;
+	int n1 = arg1.int_value;
 
 	return (Value){
 		.type = V_INT,
-		.int_value = result
+		.int_value = n0 < n1
 	};
 }
 
-// (sum (list l))
-Value e_func_sum(struct Expr* e) {
-
-	Value arg0 = try_eval_arg_as_type(e, 0, V_LIST);
-	
-	int result = 0;
-
-	for (int i = 0; i < arg0.list_value.num_values; i++) {
+// (> n1 n2)
+Value e_func_gt(struct Expr* e) {
 
-		Value* arg_value_n = &arg0.list_value.values[i];
-		if (arg_value_n->type != V_INT) {
-			panic("sum: argument 1 should be list of int");
-		}
+	Value arg0 = try_eval_arg_as_type(e, 0, V_INT);
+	Value arg1 = try_eval_arg_as_type(e, 1, V_INT);
 
-		result += arg_value_n->int_value;
-	}
+	int n0 = arg0.int_value;
+	int n1 = arg1.int_value;
 
 	return (Value){
 		.type = V_INT,
-		.int_value = result
+		.int_value = n0 > n1
 	};
 }
 
-// (range start stop)
-Value e_func_range(struct Expr* e) {
+// (<= n1 n2)
+Value e_func_le(struct Expr* e) {
 
 	Value arg0 = try_eval_arg_as_type(e, 0, V_INT);
 	Value arg1 = try_eval_arg_as_type(e, 1, V_INT);
 
-	int start = arg0.int_value;
-	int stop = arg1.int_value;
-
-	ValueList result = vl_new();
-
-	for (int i = start; i < stop; i++) {
-		vl_append(result, (Value){
-			.type = V_INT,
-			.int_value = i	
-		});
-	}
+	int n0 = arg0.int_value;
+	int n1 = arg1.int_value;
 
 	return (Value){
-		.type = V_LIST,
-		.list_value = result
+		.type = V_INT,
+		.int_value = n0 <= n1
 	};
 }
 
-// (if cond expr1 expr2)
-Value e_func_if(struct Expr* e) {
+// (>= n1 n2)
+Value e_func_ge(struct Expr* e) {
 
 	Value arg0 = try_eval_arg_as_type(e, 0, V_INT);
 	Value arg1 = try_eval_arg_as_type(e, 1, V_INT);
-	Value arg2 = try_eval_arg_as_type(e, 2, V_INT);
-
-	int if_cond = arg0.int_value;
-	int then_expr = arg1.int_value;
-	int else_expr = arg2.int_value;
 
-	int result = if_cond ? then_expr : else_expr;
+	int n0 = arg0.int_value;
+	int n1 = arg1.int_value;
 
 	return (Value){
 		.type = V_INT,
-		.int_value = result
+		.int_value = n0 >= n1
 	};
 }
 
-// another associative type
-typedef struct {
-	char* name;
-	Value value;
-} VarData;
+// (bool (int x))
+Value e_func_bool(struct Expr* e) {
 
-typedef struct {
-	VarData* vars;
-	int num_vars;	
-} RT_VarList;
+	Value arg0 = try_eval_arg_as_type(e, 0, V_INT);
+
+	int n0 = arg0.int_value;
+
+	return (Value){
+		.type = V_INT,
+		.int_value = !!n0
+	};
+}
+
+size_t e_func_fib_r(size_t n) {
+	if (n < 2)
+		return 1;
+	else
+		return e_func_fib_r(n-1) + e_func_fib_r(n-2);
+}
+
+// e_func_fib_r, charging each call as a step. the budget is checked
+// between subproblems small enough to take a few microseconds
+size_t e_func_fib_budgeted(int n) {
+	if (n <= 20) {
+		size_t r = e_func_fib_r(n);
+		rt_charge(2 * r - 1); // fib_r(n) makes 2 * fib(n) - 1 calls
+		return r;
+	}
+	return e_func_fib_budgeted(n - 1) + e_func_fib_budgeted(n - 2);
+}
+
+// (fib n)
+Value e_func_fib(struct Expr* e) {
+
+	Value arg0 = try_eval_arg_as_type(e, 0, V_INT);
+
+	int n = arg0.int_value;
+
+	// as size_t a negative n never gets down to the base case
+	return (Value){
+		.type = V_INT,
+		.int_value = e_func_fib_budgeted(n < 0 ? 0 : n)
+	};
+}
+
+/*	sequences: a pull-based iterator over the elements of a list.
+
+	map, filter, take and range don't build a ValueList when their result is
+	consumed by another list function. instead the consumer opens a chain of
+	Seqs over the argument expression and pulls one element at a time, so
+	(sum (map sq (filter odd (range 0 n)))) runs as one loop in constant
+	memory. a Seq call only materializes when its result is needed as an
+	actual list value (top level, len of a plain list, etc) */
+
+typedef enum {
+	SEQ_LIST, // walk an existing ValueList
+	SEQ_RANGE, // [cur, stop)
+	SEQ_MAP, // (f x) for each x in src
+	SEQ_FILTER, // x for each x in src where (f x) != 0
+	SEQ_TAKE // first n of src
+} SeqType;
+
+// a call to a function value with up to 2 already evaluated args, which
+// is reused for every element instead of being rebuilt each time. the args
+// come first since children are found by counting back from the call
+typedef struct {
+	Expr args[2];
+	Expr call;
+} FuncApply;
+
+typedef struct Seq {
+	SeqType type;
+	struct Seq* src;
+	union {
+		// SEQ_LIST
+		struct { ValueList list; int pos; };
+		// SEQ_RANGE
+		struct { int cur; int stop; };
+		// SEQ_MAP, SEQ_FILTER
+		FuncApply apply;
+		// SEQ_TAKE
+		int remaining;
+	};
+} Seq;
+
+#define seq_new() \
+	((Seq*)rt_calloc(sizeof(Seq)))
+
+// prepare a call of a V_FUNC value with num_args args, see func_apply()
+void func_apply_init(FuncApply* fa, Value f, int num_args, char* who) {
+	E_FuncData* fd = f.func_value;
+
+	if (fd->num_args != RTFN_VARARGS && fd->num_args != num_args) {
+		panic("%s: function %s takes %d arguments, expected %d",
+			who,
+			fd->name,
+			fd->num_args,
+			num_args);
+	}
+
+	fa->call = (Expr){
+		.type = E_APPLY,
+		.num_kids = num_args,
+		.kids = 2,
+		.func = fd
+	};
+
+	for (int i = 0; i < num_args; i++) {
+		fa->args[i] = (Expr){.type = E_VALUE};
+	}
+}
+
+#define func_apply(fa) \
+	((fa)->call.func->actual_function(&(fa)->call))
+
+bool is_seq_call(Expr* e) {
+	if (e->type != E_FUNCCALL) {
+		return false;
+	}
+
+	E_Func* f = expr_func(e)->actual_function;
+	return f == e_func_map
+		|| f == e_func_filter
+		|| f == e_func_take
+		|| f == e_func_range;
+}
+
+Seq* seq_build(Expr* e);
+
+// open argument arg_num of e as a sequence, fusing it if possible
+Seq* seq_open_arg(Expr* e, int arg_num) {
+
+	Expr* arg = expr_arg(e, arg_num);
+
+	if (RT->ctx->fuse && is_seq_call(arg)) {
+		return seq_build(arg);
+	}
+
+	Seq* s = seq_new();
+	s->type = SEQ_LIST;
+	s->list = try_eval_arg_as_type(e, arg_num, V_LIST).list_value;
+	return s;
+}
+
+// e must be a call to one of the functions in is_seq_call()
+Seq* seq_build(Expr* e) {
+
+	E_FuncData* fd = expr_func(e);
+	E_Func* f = fd->actual_function;
+	Seq* s = seq_new();
+
+	if (f == e_func_range) {
+		s->type = SEQ_RANGE;
+		s->cur = try_eval_arg_as_type(e, 0, V_INT).int_value;
+		s->stop = try_eval_arg_as_type(e, 1, V_INT).int_value;
+	} else if (f == e_func_take) {
+		s->type = SEQ_TAKE;
+		s->remaining = try_eval_arg_as_type(e, 0, V_INT).int_value;
+		s->src = seq_open_arg(e, 1);
+	} else {
+		s->type = (f == e_func_map) ? SEQ_MAP : SEQ_FILTER;
+		Value fn = try_eval_arg_as_type(e, 0, V_FUNC);
+		func_apply_init(&s->apply, fn, 1, fd->name);
+		s->src = seq_open_arg(e, 1);
+	}
+
+	return s;
+}
+
+void seq_free(Seq* s) {
+	while (s != NULL) {
+		Seq* src = s->src;
+		rt_free(s);
+		s = src;
+	}
+}
+
+bool seq_next(Seq* s, Value* out) {
+	Value v;
+
+	rt_charge(1);
+
+	switch (s->type) {
+		case SEQ_LIST:
+			// a mapped list lets go of each window, and of the last one
+			if (s->pos >= s->list.num_values) {
+				if (vl_mapped(s->list) && s->pos > 0) {
+					vl_release(s->list, (s->pos - 1) / MAPPED_WINDOW * MAPPED_WINDOW, s->pos);
+				}
+				return false;
+			}
+			if (vl_mapped(s->list) && s->pos > 0 && s->pos % MAPPED_WINDOW == 0) {
+				vl_release(s->list, s->pos - MAPPED_WINDOW, s->pos);
+			}
+			*out = vl_get(s->list, s->pos++);
+			return true;
+
+		case SEQ_RANGE:
+			if (s->cur >= s->stop) {
+				return false;
+			}
+			*out = (Value){.type = V_INT, .int_value = s->cur++};
+			return true;
+
+		case SEQ_MAP:
+			if (!seq_next(s->src, &v)) {
+				return false;
+			}
+			s->apply.args[0].value = v;
+			*out = func_apply(&s->apply);
+			if (out->type != V_INT) {
+				panic("map: function %s returned %s, expected int",
+					s->apply.call.func->name,
+					stringify_value_type(out->type));
+			}
+			return true;
+
+		case SEQ_FILTER:
+			while (seq_next(s->src, &v)) {
+				s->apply.args[0].value = v;
+				Value keep = func_apply(&s->apply);
+				if (keep.type != V_INT) {
+					panic("filter: function %s returned %s, expected int",
+						s->apply.call.func->name,
+						stringify_value_type(keep.type));
+				}
+				if (keep.int_value) {
+					*out = v;
+					return true;
+				}
+			}
+			return false;
+
+		case SEQ_TAKE:
+			if (s->remaining <= 0 || !seq_next(s->src, out)) {
+				return false;
+			}
+			s->remaining--;
+			return true;
+	}
+
+	return false;
+}
+
+// drain a sequence into a new list
+Value seq_collect(Seq* s) {
+
+	ValueList result = vl_new();
+	Value v;
+
+	while (seq_next(s, &v)) {
+		vl_append(result, v);
+	}
+
+	seq_free(s);
+
+	return (Value){
+		.type = V_LIST,
+		.list_value = result
+	};
+}
+
+/*	parallel reductions: sum/len/min/max over a long list or fused Seq chain
+	split the source into chunks, reduce each chunk on the thread pool and
+	combine the partial results. only chains of map/filter over a list or
+	range can be split (take depends on everything before it) */
+
+typedef void PoolTask(void* arg, int chunk);
+
+// which of the pool's threads is running a chunk, num_threads for the
+// calling one
+static __thread int pool_thread;
+
+// a fixed set of worker threads that run the chunks of one job at a time
+typedef struct ThreadPool {
+	pthread_t* threads;
+	int num_threads;
+	bool stopping;
+
+	pthread_mutex_t lock;
+	pthread_cond_t job_ready;
+	pthread_cond_t job_done;
+	int generation; // bumped once per job
+
+	PoolTask* task;
+	void* arg;
+	int num_chunks;
+	atomic_int next_chunk;
+	int num_busy;
+	atomic_int num_started; // hands out the threads' numbers
+
+	// eval stacks of each thread and the calling one, made the first time
+	// a chunk evaluates on it, see par_reduce_chunk()
+	Value** stacks;
+	struct Frame** frames;
+} ThreadPool;
+
+// claim and run chunks of the current job until there are none left
+void pool_run_chunks(ThreadPool* p, int thread) {
+	pool_thread = thread;
+	int chunk;
+	while ((chunk = atomic_fetch_add(&p->next_chunk, 1)) < p->num_chunks) {
+		p->task(p->arg, chunk);
+	}
+}
+
+void* pool_worker(void* arg) {
+	ThreadPool* p = arg;
+	int thread = atomic_fetch_add(&p->num_started, 1);
+	int seen = 0;
+
+	pthread_mutex_lock(&p->lock);
+	for (;;) {
+		while (p->generation == seen && !p->stopping) {
+			pthread_cond_wait(&p->job_ready, &p->lock);
+		}
+		if (p->stopping) {
+			break;
+		}
+		seen = p->generation;
+		p->num_busy++;
+		pthread_mutex_unlock(&p->lock);
+
+		pool_run_chunks(p, thread);
+
+		pthread_mutex_lock(&p->lock);
+		if (--p->num_busy == 0) {
+			pthread_cond_signal(&p->job_done);
+		}
+	}
+	pthread_mutex_unlock(&p->lock);
+	return NULL;
+}
+
+ThreadPool* pool_new(int num_threads) {
+	ThreadPool* p = calloc(1, sizeof(ThreadPool));
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->job_ready, NULL);
+	pthread_cond_init(&p->job_done, NULL);
+
+	p->num_threads = num_threads;
+	p->threads = malloc(sizeof(pthread_t) * num_threads);
+	p->stacks = calloc(num_threads + 1, sizeof(Value*));
+	p->frames = calloc(num_threads + 1, sizeof(struct Frame*));
+	for (int i = 0; i < num_threads; i++) {
+		pthread_create(&p->threads[i], NULL, pool_worker, p);
+	}
+	return p;
+}
+
+void pool_free(ThreadPool* p) {
+	pthread_mutex_lock(&p->lock);
+	p->stopping = true;
+	pthread_cond_broadcast(&p->job_ready);
+	pthread_mutex_unlock(&p->lock);
+
+	for (int i = 0; i < p->num_threads; i++) {
+		pthread_join(p->threads[i], NULL);
+	}
+
+	pthread_mutex_destroy(&p->lock);
+	pthread_cond_destroy(&p->job_ready);
+	pthread_cond_destroy(&p->job_done);
+	for (int i = 0; i <= p->num_threads; i++) {
+		free(p->stacks[i]);
+		free(p->frames[i]);
+	}
+	free(p->stacks);
+	free(p->frames);
+	free(p->threads);
+	free(p);
+}
+
+// run task(arg, 0..num_chunks-1) across the pool and the calling thread
+void pool_run(ThreadPool* p, PoolTask* task, void* arg, int num_chunks) {
+
+	pthread_mutex_lock(&p->lock);
+	p->task = task;
+	p->arg = arg;
+	p->num_chunks = num_chunks;
+	atomic_store(&p->next_chunk, 0);
+	p->generation++;
+	pthread_cond_broadcast(&p->job_ready);
+	pthread_mutex_unlock(&p->lock);
+
+	pool_run_chunks(p, p->num_threads);
+
+	// wait for workers still running their last chunk
+	pthread_mutex_lock(&p->lock);
+	while (p->num_busy > 0) {
+		pthread_cond_wait(&p->job_done, &p->lock);
+	}
+	pthread_mutex_unlock(&p->lock);
+}
+
+typedef enum {
+	RED_SUM,
+	RED_COUNT,
+	RED_MIN,
+	RED_MAX
+} ReduceOp;
+
+// the partial result of reducing one chunk
+typedef struct {
+	int acc;
+	bool any; // false if the chunk produced no elements
+} Partial;
+
+Partial partial_combine(ReduceOp op, Partial a, Partial b) {
+	if (!a.any) return b;
+	if (!b.any) return a;
+
+	switch (op) {
+		case RED_SUM:
+		case RED_COUNT:
+			// wraps around like mapped_reduce_window(), whatever the chunks
+			a.acc = (int)((uint32_t)a.acc + (uint32_t)b.acc);
+			break;
+		case RED_MIN:
+			a.acc = b.acc < a.acc ? b.acc : a.acc;
+			break;
+		case RED_MAX:
+			a.acc = b.acc > a.acc ? b.acc : a.acc;
+			break;
+	}
+	return a;
+}
+
+// op over a window of a mapped list, without making a Value of each int
+int mapped_reduce_window(ValueList w, ReduceOp op) {
+	if (w.start == VL_INT64) {
+		const uint64_t* p = (const uint64_t*)w.values;
+		int64_t lo = INT64_MAX, hi = INT64_MIN;
+		uint32_t sum = 0;
+		for (int i = 0; i < w.num_values; i++) {
+			int64_t n = (int64_t)le64toh(p[i]);
+			lo = n < lo ? n : lo;
+			hi = n > hi ? n : hi;
+			sum += (uint32_t)n;
+		}
+		if (lo < INT_MIN || hi > INT_MAX) {
+			// panics at the first one that doesn't fit
+			for (int i = 0; i < w.num_values; i++) {
+				vl_mapped_int(w, i);
+			}
+		}
+		return op == RED_SUM ? (int)sum : (op == RED_MIN ? lo : hi);
+	}
+
+	const uint32_t* p = (const uint32_t*)w.values;
+	if (op == RED_SUM) {
+		uint32_t sum = 0;
+		for (int i = 0; i < w.num_values; i++) {
+			sum += le32toh(p[i]);
+		}
+		return sum;
+	}
+	int32_t acc = le32toh(p[0]);
+	if (op == RED_MIN) {
+		for (int i = 1; i < w.num_values; i++) {
+			int32_t n = le32toh(p[i]);
+			acc = n < acc ? n : acc;
+		}
+	} else {
+		for (int i = 1; i < w.num_values; i++) {
+			int32_t n = le32toh(p[i]);
+			acc = n > acc ? n : acc;
+		}
+	}
+	return acc;
+}
+
+// seq_reduce() straight off a mapped list, elements [lo, hi). the pages of
+// each window are let go of once it is done, so only a window or so of the
+// file is ever in memory
+Partial mapped_reduce(ValueList l, int lo, int hi, ReduceOp op) {
+	Partial r = {0};
+	for (int w = lo; w < hi; w += MAPPED_WINDOW) {
+		int end = hi - w < MAPPED_WINDOW ? hi : w + MAPPED_WINDOW;
+		rt_charge(end - w);
+		r = partial_combine(op, r, (Partial){
+			.acc = op == RED_COUNT ? end - w : mapped_reduce_window(vl_slice(l, w, end), op),
+			.any = true
+		});
+		vl_release(l, w, end);
+	}
+	return r;
+}
+
+Partial seq_reduce(Seq* s, ReduceOp op, char* who) {
+	Partial r = {0};
+	Value v;
+
+	if (s->type == SEQ_LIST && vl_mapped(s->list)) {
+		r = mapped_reduce(s->list, s->pos, s->list.num_values, op);
+		s->pos = s->list.num_values;
+		return r;
+	}
+
+	while (seq_next(s, &v)) {
+		if (v.type != V_INT) {
+			panic("%s: argument 1 should be list of int", who);
+		}
+		r = partial_combine(op, r, (Partial){
+			.acc = (op == RED_COUNT) ? 1 : v.int_value,
+			.any = true
+		});
+	}
+
+	return r;
+}
+
+// the list or range at the bottom of a chain, or NULL if it can't be split
+Seq* seq_splittable_source(Seq* s) {
+	for (; s != NULL; s = s->src) {
+		if (s->type == SEQ_LIST || s->type == SEQ_RANGE) {
+			return s;
+		}
+		if (s->type == SEQ_TAKE) {
+			return NULL;
+		}
+	}
+	return NULL;
+}
+
+int seq_source_len(Seq* source) {
+	return (source->type == SEQ_LIST)
+		? source->list.num_values - source->pos
+		: (source->stop > source->cur ? source->stop - source->cur : 0);
+}
+
+// copy a chain whose source only covers elements [lo, hi)
+Seq* seq_clone_slice(Seq* s, int lo, int hi) {
+	Seq* c = seq_new();
+	*c = *s;
+
+	if (s->type == SEQ_MAP || s->type == SEQ_FILTER) {
+		c->src = seq_clone_slice(s->src, lo, hi);
+	} else if (s->type == SEQ_LIST) {
+		c->pos = s->pos + lo;
+		c->list.num_values = s->pos + hi;
+	} else if (s->type == SEQ_RANGE) {
+		c->cur = s->cur + lo;
+		c->stop = s->cur + hi;
+	}
+
+	return c;
+}
+
+typedef struct {
+	lisp_ctx* ctx;
+	Seq* seq;
+	ReduceOp op;
+	char* who;
+	int len;
+	int num_chunks;
+	Partial* partials;
+
+	// of the calling thread
+	uint64_t deadline;
+	const int* params;
+	int num_params;
+
+	SharedBudget budget;
+	int64_t max_steps;
+	size_t max_bytes;
+
+	// the first error raised by a chunk, re-raised by the calling thread
+	pthread_mutex_t lock;
+	bool failed;
+	char error[RT_ERROR_MAX];
+} ParReduce;
+
+void par_reduce_chunk(void* arg, int chunk) {
+	ParReduce* pr = arg;
+
+	// another chunk failed, the reduce is off
+	if (atomic_load(&pr->budget.stop)) {
+		return;
+	}
+
+	int lo = (int)((long)pr->len * chunk / pr->num_chunks);
+	int hi = (int)((long)pr->len * (chunk + 1) / pr->num_chunks);
+
+	// chunks run with their own state, even on the calling thread
+	RT_State* saved = RT;
+	Heap heap = {0};
+	jmp_buf on_error;
+	char error[RT_ERROR_MAX];
+	RT_State state = {
+		.ctx = pr->ctx,
+		.builtins = pr->ctx->builtins.fns,
+		.heap = &heap,
+		.on_error = &on_error,
+		.error = error,
+		.max_steps = pr->max_steps,
+		.max_bytes = pr->max_bytes,
+		.deadline = pr->deadline,
+		.params = pr->params,
+		.num_params = pr->num_params,
+		.in_chunk = true,
+		.shared = &pr->budget
+	};
+	RT = &state;
+
+	if (setjmp(on_error) == 0) {
+		// the thread's stacks, like rt_eval_setup() does with the ctx's
+		ThreadPool* p = pr->ctx->pool;
+		int thread = pool_thread;
+		if (p->stacks[thread] == NULL) {
+			p->stacks[thread] = malloc(sizeof(Value) * RT_STACK_SIZE);
+			p->frames[thread] = malloc(sizeof(Frame) * RT_FRAMES_SIZE);
+			if (p->stacks[thread] == NULL || p->frames[thread] == NULL) {
+				panic("out of memory");
+			}
+		}
+		state.stack = p->stacks[thread];
+		state.stack_cap = RT_STACK_SIZE;
+		state.frames = p->frames[thread];
+		state.frames_cap = RT_FRAMES_SIZE;
+
+		Seq* s = seq_clone_slice(pr->seq, lo, hi);
+		pr->partials[chunk] = seq_reduce(s, pr->op, pr->who);
+		// count the steps since the last check, which can still fail
+		budget_check();
+	} else {
+		pthread_mutex_lock(&pr->lock);
+		if (!pr->failed) {
+			pr->failed = true;
+			memcpy(pr->error, error, RT_ERROR_MAX);
+		}
+		pthread_mutex_unlock(&pr->lock);
+		atomic_store(&pr->budget.stop, true);
+	}
+
+	heap_free_all(&heap);
+	RT = saved;
+}
+
+// reduce argument arg_num of e, in parallel if it is big enough
+Partial reduce_arg(Expr* e, int arg_num, ReduceOp op) {
+
+	char* who = expr_func(e)->name;
+	Seq* s = seq_open_arg(e, arg_num);
+	Seq* source = seq_splittable_source(s);
+
+	lisp_ctx* ctx = RT->ctx;
+	Partial r;
+
+	if (op == RED_COUNT && s->type == SEQ_LIST) {
+		r = (Partial){.acc = seq_source_len(s), .any = true};
+	} else if (ctx->num_threads > 1
+	&& !RT->in_chunk
+	&& source != NULL
+	&& seq_source_len(source) >= ctx->par_threshold) {
+
+		if (ctx->pool == NULL) {
+			ctx->pool = pool_new(ctx->num_threads - 1);
+		}
+
+		ParReduce pr = {
+			.ctx = ctx,
+			.seq = s,
+			.op = op,
+			.who = who,
+			.len = seq_source_len(source),
+			// a few chunks per thread so that uneven filters balance out
+			.num_chunks = ctx->num_threads * 4,
+			.max_steps = RT->max_steps,
+			.max_bytes = RT->max_bytes,
+			.deadline = RT->deadline,
+			.params = RT->params,
+			.num_params = RT->num_params
+		};
+		pr.partials = rt_calloc(pr.num_chunks * sizeof(Partial));
+		pthread_mutex_init(&pr.lock, NULL);
+
+		// the chunks go on from what the caller took so far
+		int64_t steps = budget_steps();
+		atomic_init(&pr.budget.steps, steps);
+		atomic_init(&pr.budget.bytes, RT->heap->bytes);
+		atomic_init(&pr.budget.stop, false);
+
+		pool_run(ctx->pool, par_reduce_chunk, &pr, pr.num_chunks);
+
+		pthread_mutex_destroy(&pr.lock);
+		if (pr.failed) {
+			rt_raise("%s", pr.error);
+		}
+		rt_charge(atomic_load(&pr.budget.steps) - steps);
+
+		r = (Partial){0};
+		for (int i = 0; i < pr.num_chunks; i++) {
+			r = partial_combine(op, r, pr.partials[i]);
+		}
+		rt_free(pr.partials);
+
+	} else {
+		r = seq_reduce(s, op, who);
+	}
+
+	seq_free(s);
+	return r;
+}
+
+// (list (int n0) (int n1) ...)
+Value e_func_list(struct Expr* e) {
+
+	ValueList result = vl_new();
+
+	// empty list
+	if (e->num_kids == 0) {
+		return (Value){
+			.type = V_LIST,
+			.list_value = result
+		};
+	}
+
+	for (uint32_t i = 0; i < e->num_kids; i++) {
+		Value list_item = try_eval_arg_as_type(e, i, V_INT);
+		vl_append(result, list_item);
+	}
+	
+	return (Value){
+		.type = V_LIST,
+		.list_value = result
+	};
+}
+
+// (len (list l))
+Value e_func_len(struct Expr* e) {
+
+	int result = reduce_arg(e, 0, RED_COUNT).acc;
+
+	return (Value){
+		.type = V_INT,
+		.int_value = result
+	};
+}
+
+// (sum (list l))
+Value e_func_sum(struct Expr* e) {
+
+	int result = reduce_arg(e, 0, RED_SUM).acc;
+
+	return (Value){
+		.type = V_INT,
+		.int_value = result
+	};
+}
+
+// (min (list l))
+Value e_func_min(struct Expr* e) {
+
+	Partial r = reduce_arg(e, 0, RED_MIN);
+	if (!r.any) {
+		panic("min: list is empty");
+	}
+
+	return (Value){
+		.type = V_INT,
+		.int_value = r.acc
+	};
+}
+
+// (max (list l))
+Value e_func_max(struct Expr* e) {
+
+	Partial r = reduce_arg(e, 0, RED_MAX);
+	if (!r.any) {
+		panic("max: list is empty");
+	}
+
+	return (Value){
+		.type = V_INT,
+		.int_value = r.acc
+	};
+}
+
+// (range start stop)
+Value e_func_range(struct Expr* e) {
+
+	Value arg0 = try_eval_arg_as_type(e, 0, V_INT);
+	Value arg1 = try_eval_arg_as_type(e, 1, V_INT);
+
+	int start = arg0.int_value;
+	int stop = arg1.int_value;
+
+	ValueList result = vl_new();
+
+	for (int i = start; i < stop; i++) {
+		vl_append(result, (Value){
+			.type = V_INT,
+			.int_value = i	
+		});
+	}
+
+	return (Value){
+		.type = V_LIST,
+		.list_value = result
+	};
+}
+
+// (sq n)
+Value e_func_sq(struct Expr* e) {
+
+	Value arg0 = try_eval_arg_as_type(e, 0, V_INT);
+
+	int n = arg0.int_value;
+
+	return (Value){
+		.type = V_INT,
+		.int_value = n * n
+	};
+}
+
+// (odd n)
+Value e_func_odd(struct Expr* e) {
+
+	Value arg0 = try_eval_arg_as_type(e, 0, V_INT);
+
+	int n = arg0.int_value;
+
+	return (Value){
+		.type = V_INT,
+		.int_value = (n % 2) != 0
+	};
+}
+
+// (even n)
+Value e_func_even(struct Expr* e) {
+
+	Value arg0 = try_eval_arg_as_type(e, 0, V_INT);
+
+	int n = arg0.int_value;
+
+	return (Value){
+		.type = V_INT,
+		.int_value = (n % 2) == 0
+	};
+}
+
+// (map f (list l))
+Value e_func_map(struct Expr* e) {
+	return seq_collect(seq_build(e));
+}
+
+// (filter f (list l))
+Value e_func_filter(struct Expr* e) {
+	return seq_collect(seq_build(e));
+}
+
+// (take n (list l))
+Value e_func_take(struct Expr* e) {
+	return seq_collect(seq_build(e));
+}
+
+// (nth i (list l)), the element at index i
+Value e_func_nth(struct Expr* e) {
+
+	int i = try_eval_arg_as_type(e, 0, V_INT).int_value;
+	ValueList l = try_eval_arg_as_type(e, 1, V_LIST).list_value;
+
+	if (i < 0 || i >= l.num_values) {
+		panic("nth: index %d is out of range for a list of %d", i, l.num_values);
+	}
+
+	return vl_get(l, i);
+}
+
+// (slice lo hi (list l)), elements [lo, hi) of l without copying them.
+// like take, the bounds are clamped to the list
+Value e_func_slice(struct Expr* e) {
+
+	int lo = try_eval_arg_as_type(e, 0, V_INT).int_value;
+	int hi = try_eval_arg_as_type(e, 1, V_INT).int_value;
+	ValueList l = try_eval_arg_as_type(e, 2, V_LIST).list_value;
+
+	lo = lo < 0 ? 0 : (lo > l.num_values ? l.num_values : lo);
+	hi = hi < lo ? lo : (hi > l.num_values ? l.num_values : hi);
+
+	if (lo == hi) {
+		return (Value){.type = V_LIST, .list_value = vl_new()};
+	}
+
+	return (Value){.type = V_LIST, .list_value = vl_slice(l, lo, hi)};
+}
+
+// (push (int n) (list l)), l with n added at the end
+Value e_func_push(struct Expr* e) {
+
+	Value n = try_eval_arg_as_type(e, 0, V_INT);
+	ValueList l = try_eval_arg_as_type(e, 1, V_LIST).list_value;
+
+	// not vl_append(), other lists may share l's buffer
+	rt_charge(1);
+	l = vl_grow(l, 1);
+	l.values[l.num_values - 1] = n;
+
+	return (Value){
+		.type = V_LIST,
+		.list_value = l
+	};
+}
+
+// (concat (list a) (list b)), costs the length of b when a is the newest
+// version of its list
+Value e_func_concat(struct Expr* e) {
+
+	ValueList a = try_eval_arg_as_type(e, 0, V_LIST).list_value;
+	ValueList b = try_eval_arg_as_type(e, 1, V_LIST).list_value;
+
+	if (b.num_values == 0) {
+		return (Value){.type = V_LIST, .list_value = a};
+	}
+
+	rt_charge(b.num_values);
+	ValueList result = vl_grow(a, b.num_values);
+	if (vl_mapped(b)) {
+		for (int i = 0; i < b.num_values; i++) {
+			result.values[a.num_values + i] = vl_get(b, i);
+		}
+	} else {
+		memcpy(result.values + a.num_values, b.values, sizeof(Value) * b.num_values);
+	}
+
+	return (Value){
+		.type = V_LIST,
+		.list_value = result
+	};
+}
+
+/*	load-ints maps its file instead of reading it, and the list it makes
+	is a view of the mapping (see VL_INT32). pages are read in as the list
+	is used and let go of again as reductions stream over it. a mapping
+	lives as long as the values of the evaluation that made it, so every
+	one is remembered in the ctx and unmapped with its eval_heap */
+typedef struct Mapping {
+	void* addr;
+	size_t len;
+	struct Mapping* next;
+} Mapping;
+
+// the text of string literal argument arg_num, in a new allocation
+char* expr_string_arg(Expr* e, int arg_num) {
+	Expr* arg = expr_arg(e, arg_num);
+	if (arg->type != E_STRING) {
+		E_FuncData* fd = expr_func(e);
+		panic("%.*s: argument %d should be a string literal", fd->name_len, fd->name, arg_num);
+	}
+	char* s = rt_alloc(arg->str.len + 1);
+	if (s == NULL) {
+		panic("out of memory");
+	}
+	memcpy(s, arg->str.name, arg->str.len);
+	s[arg->str.len] = '\0';
+	return s;
+}
+
+// the file of little-endian ints width bytes wide named by e's argument
+Value load_ints(Expr* e, int width) {
+	E_FuncData* fd = expr_func(e);
+	char* path = expr_string_arg(e, 0);
+
+	int fd_file = open(path, O_RDONLY | O_CLOEXEC);
+	struct stat st;
+	if (fd_file < 0 || fstat(fd_file, &st) != 0) {
+		int err = errno;
+		if (fd_file >= 0) {
+			close(fd_file);
+		}
+		panic("%.*s: %s: %s", fd->name_len, fd->name, path, strerror(err));
+	}
+	size_t len = st.st_size;
+	if (len % width != 0 || len / width > INT_MAX) {
+		close(fd_file);
+		panic("%.*s: %s is not a list of up to %d ints of %d bytes", fd->name_len, fd->name, path, INT_MAX, width);
+	}
+	if (len == 0) {
+		close(fd_file);
+		rt_free(path);
+		return (Value){.type = V_LIST, .list_value = vl_new()};
+	}
+
+	void* addr = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd_file, 0);
+	int err = errno;
+	close(fd_file);
+	if (addr == MAP_FAILED) {
+		panic("%.*s: %s: %s", fd->name_len, fd->name, path, strerror(err));
+	}
+	madvise(addr, len, MADV_SEQUENTIAL);
+
+	Mapping* m = malloc(sizeof(Mapping));
+	if (m == NULL) {
+		munmap(addr, len);
+		panic("out of memory");
+	}
+	*m = (Mapping){.addr = addr, .len = len};
+	lisp_ctx* ctx = RT->ctx;
+	pthread_mutex_lock(&ctx->mappings_lock);
+	m->next = ctx->mappings;
+	ctx->mappings = m;
+	pthread_mutex_unlock(&ctx->mappings_lock);
+
+	rt_free(path);
+	return (Value){
+		.type = V_LIST,
+		.list_value = {
+			.values = addr,
+			.num_values = len / width,
+			.start = -width
+		}
+	};
+}
+
+// (load-ints "path"), a file of int32s as a list
+Value e_func_load_ints(struct Expr* e) {
+	return load_ints(e, 4);
+}
+
+// (load-ints64 "path"), a file of int64s as a list. reading an element
+// that doesn't fit in an int is an error
+Value e_func_load_ints64(struct Expr* e) {
+	return load_ints(e, 8);
+}
+
+// drop the values of the last evaluation, with the files they map
+void free_results(lisp_ctx* ctx) {
+	heap_free_all(&ctx->eval_heap);
+	while (ctx->mappings != NULL) {
+		Mapping* m = ctx->mappings;
+		ctx->mappings = m->next;
+		munmap(m->addr, m->len);
+		free(m);
+	}
+}
+
+/*	maps: a MapTable is a log of every put made to a map and its later
+	versions, and a ValueMap is a view of the first version entries of
+	it, the way a ValueList is a view of a buffer. each entry links back
+	to the one it replaced for the same key, and an index of open
+	addressing slots (key and entry, 8 bytes, linear probing) points at
+	the newest entry for each key. a put to the newest version of a map
+	appends to the log in place, and every older version still sees
+	exactly what it had: a lookup walks back from the newest entry past
+	the ones that version can't see. a put to an older version, or to a
+	map another thread's heap owns (see par_reduce_chunk()), copies what
+	it sees into a new table first.
+	the index never stops the world to grow: at half full a new one
+	twice the size is allocated (without touching it, see
+	map_new_slots()), and every put after that moves MAP_MIGRATE slots of
+	the old one over until it's empty. until then lookups try the new
+	one, then the old one. the log grows a block at a time so it is never
+	copied either */
+typedef struct {
+	int key;
+	int ref; // 1 + the index of its entry in the log, 0 if the slot is empty
+} MapSlot;
+
+typedef struct {
+	int key;
+	int value;
+	int prev; // entry this one replaced, or -1
+} MapEntry;
+
+#define MAP_BLOCK_BITS 12
+#define MAP_BLOCK_SIZE (1 << MAP_BLOCK_BITS)
+#define MAP_MIGRATE 16
+
+typedef struct MapTable {
+	Heap* heap; // the heap it was built on, the only one it grows on
+
+	// the log, MAP_BLOCK_SIZE entries per block
+	MapEntry** blocks;
+	int num_blocks;
+	int num_entries; // what the newest version sees
+
+	MapSlot* slots;
+	int cap; // a power of 2
+	int used; // slots in use
+
+	// the index being moved out of, NULL if none
+	MapSlot* old_slots;
+	int old_cap;
+	int migrated; // old slots moved so far
+} MapTable;
+
+#define map_entry(t, i) \
+	(&(t)->blocks[(i) >> MAP_BLOCK_BITS][(i) & (MAP_BLOCK_SIZE - 1)])
+
+uint32_t map_hash(int key) {
+	uint32_t x = key;
+	x ^= x >> 16;
+	x *= 0x85ebca6b;
+	x ^= x >> 13;
+	x *= 0xc2b2ae35;
+	x ^= x >> 16;
+	return x;
+}
+
+// the slot of key in slots, or the empty one where it would go
+MapSlot* map_slot(MapSlot* slots, int cap, int key) {
+	uint32_t i = map_hash(key) & (cap - 1);
+	while (slots[i].ref != 0 && slots[i].key != key) {
+		i = (i + 1) & (cap - 1);
+	}
+	return &slots[i];
+}
+
+// zeroed by rt_calloc(), so a large index costs nothing until it's used
+MapSlot* map_new_slots(int cap) {
+	return rt_calloc(sizeof(MapSlot) * cap);
+}
+
+MapTable* map_new_table(int cap) {
+	MapTable* t = rt_calloc(sizeof(MapTable));
+	t->heap = RT->heap;
+	t->slots = map_new_slots(cap);
+	t->cap = cap;
+	return t;
+}
+
+// the newest entry for key, in either index, or -1
+int map_newest(MapTable* t, int key) {
+	MapSlot* s = map_slot(t->slots, t->cap, key);
+	if (s->ref == 0 && t->old_slots != NULL) {
+		s = map_slot(t->old_slots, t->old_cap, key);
+	}
+	return s->ref - 1;
+}
+
+// the entry for key that m sees, or -1
+int map_find(ValueMap m, int key) {
+	if (m.table == NULL) {
+		return -1;
+	}
+	int e = map_newest(m.table, key);
+	while (e >= m.version) {
+		e = map_entry(m.table, e)->prev;
+	}
+	return e;
+}
+
+// move up to n slots of the old index into the new one. a key that is
+// in the new one already was put again since, so that one is newer
+void map_migrate(MapTable* t, int n) {
+	for (; n > 0 && t->migrated < t->old_cap; n--, t->migrated++) {
+		MapSlot* from = &t->old_slots[t->migrated];
+		if (from->ref != 0) {
+			MapSlot* to = map_slot(t->slots, t->cap, from->key);
+			if (to->ref == 0) {
+				*to = *from;
+				t->used++;
+			}
+		}
+	}
+	if (t->old_slots != NULL && t->migrated == t->old_cap) {
+		rt_free(t->old_slots);
+		t->old_slots = NULL;
+	}
+}
+
+// append a put of key to the newest version of t
+void map_put_newest(MapTable* t, int key, int value) {
+	rt_charge(1);
+
+	MapSlot* s = map_slot(t->slots, t->cap, key);
+	int prev = s->ref - 1;
+	if (prev < 0) {
+		if (t->old_slots != NULL) {
+			prev = map_slot(t->old_slots, t->old_cap, key)->ref - 1;
+		}
+		if ((t->used + 1) * 2 > t->cap) {
+			// a last resize that hasn't finished has to first
+			map_migrate(t, t->old_cap);
+			if (t->cap > INT_MAX / 4) {
+				panic("map too large");
+			}
+			t->old_slots = t->slots;
+			t->old_cap = t->cap;
+			t->migrated = 0;
+			t->cap *= 2;
+			t->slots = map_new_slots(t->cap);
+			t->used = 0;
+			s = map_slot(t->slots, t->cap, key);
+		}
+		t->used++;
+	}
+
+	if (t->num_entries == t->num_blocks * MAP_BLOCK_SIZE) {
+		if (t->num_entries > INT_MAX - MAP_BLOCK_SIZE) {
+			panic("map too large");
+		}
+		t->blocks = rt_realloc(t->blocks, sizeof(MapEntry*) * (t->num_blocks + 1));
+		if (t->blocks == NULL || (t->blocks[t->num_blocks] = rt_alloc(sizeof(MapEntry) * MAP_BLOCK_SIZE)) == NULL) {
+			panic("out of memory");
+		}
+		t->num_blocks++;
+	}
+	*map_entry(t, t->num_entries) = (MapEntry){.key = key, .value = value, .prev = prev};
+	*s = (MapSlot){.key = key, .ref = ++t->num_entries};
+
+	map_migrate(t, MAP_MIGRATE);
+}
+
+// what m sees, in a table of its own
+MapTable* map_copy(ValueMap m) {
+	int cap = 16;
+	while (cap < m.len * 2 + 2) {
+		cap *= 2;
+	}
+	MapTable* t = map_new_table(cap);
+	for (int i = 0; i < m.version; i++) {
+		MapEntry* e = map_entry(m.table, i);
+		if (map_find(m, e->key) == i) {
+			map_put_newest(t, e->key, e->value);
+		}
+	}
+	return t;
+}
+
+ValueMap map_put(ValueMap m, int key, int value) {
+	MapTable* t = m.table;
+	if (t == NULL || m.version != t->num_entries || t->heap != RT->heap) {
+		t = map_copy(m);
+	}
+	bool had = map_find(m, key) >= 0;
+	map_put_newest(t, key, value);
+	return (ValueMap){.table = t, .version = t->num_entries, .len = m.len + !had};
+}
+
+// (map-new), an empty map
+Value e_func_map_new(struct Expr* e) {
+	(void)e; // takes no args
+	return (Value){.type = V_MAP, .map_value = {0}};
+}
+
+// (put (int k) (int v) (map m)), m with k set to v. amortized O(1) when m
+// is the newest version of its map
+Value e_func_put(struct Expr* e) {
+
+	int k = try_eval_arg_as_type(e, 0, V_INT).int_value;
+	int v = try_eval_arg_as_type(e, 1, V_INT).int_value;
+	ValueMap m = try_eval_arg_as_type(e, 2, V_MAP).map_value;
+
+	return (Value){
+		.type = V_MAP,
+		.map_value = map_put(m, k, v)
+	};
+}
+
+// (get (int k) (map m)), the value of k in m
+Value e_func_get(struct Expr* e) {
+
+	int k = try_eval_arg_as_type(e, 0, V_INT).int_value;
+	ValueMap m = try_eval_arg_as_type(e, 1, V_MAP).map_value;
+
+	int i = map_find(m, k);
+	if (i < 0) {
+		panic("get: no key %d in the map", k);
+	}
+
+	return (Value){
+		.type = V_INT,
+		.int_value = map_entry(m.table, i)->value
+	};
+}
+
+// (has (int k) (map m)), 1 if m has k
+Value e_func_has(struct Expr* e) {
+
+	int k = try_eval_arg_as_type(e, 0, V_INT).int_value;
+	ValueMap m = try_eval_arg_as_type(e, 1, V_MAP).map_value;
+
+	return (Value){
+		.type = V_INT,
+		.int_value = map_find(m, k) >= 0
+	};
+}
+
+// (map-len (map m)), the number of keys in m
+Value e_func_map_len(struct Expr* e) {
+
+	ValueMap m = try_eval_arg_as_type(e, 0, V_MAP).map_value;
+
+	return (Value){
+		.type = V_INT,
+		.int_value = m.len
+	};
+}
+
+// (reduce f init (list l))
+Value e_func_reduce(struct Expr* e) {
+
+	Value fn = try_eval_arg_as_type(e, 0, V_FUNC);
+	Value acc = try_eval_arg_as_type(e, 1, V_INT);
+	Seq* s = seq_open_arg(e, 2);
+
+	FuncApply fa;
+	func_apply_init(&fa, fn, 2, "reduce");
+
+	Value v;
+	while (seq_next(s, &v)) {
+		fa.args[0].value = acc;
+		fa.args[1].value = v;
+		acc = func_apply(&fa);
+		if (acc.type != V_INT) {
+			panic("reduce: function %s returned %s, expected int",
+				fn.func_value->name,
+				stringify_value_type(acc.type));
+		}
+	}
+
+	seq_free(s);
+	return acc;
+}
+
+/*	frames and calls: a Frame's slots live on RT->stack unless a closure
+	refers to them (Expr.captured), in which case they go on the heap so
+	the closure can keep using them after the scope has returned.
+
+	every eval() call pops everything it pushed before it returns. so when
+	eval() reaches a call to a lambda, nothing it pushed before is needed
+	any more: the arguments are moved down to where its stack started and
+	the body is evaluated in the same loop instead of recursing. that makes
+	calls in tail position (the branches of if, the last expression of a
+	body) run in constant stack */
+
+void rt_stack_init(RT_State* st) {
+	st->stack_cap = RT_STACK_SIZE;
+	st->stack = rt_alloc(sizeof(Value) * st->stack_cap);
+	st->frames_cap = RT_FRAMES_SIZE;
+	st->frames = rt_alloc(sizeof(Frame) * st->frames_cap);
+	if (st->stack == NULL || st->frames == NULL) {
+		panic("out of memory");
+	}
+}
+
+// a frame for a scope or lambda with its first num_args slots copied from args
+Frame* push_frame(int num_slots, bool captured, Value* args, int num_args, Frame* up) {
+
+	if (RT->stack == NULL) {
+		rt_stack_init(RT);
+	}
+
+	Frame* f;
+	if (captured) {
+		f = rt_alloc(sizeof(Frame) + sizeof(Value) * num_slots);
+		f->slots = (Value*)(f + 1);
+	} else {
+		if (RT->fp == RT->frames_cap || RT->sp + num_slots > RT->stack_cap) {
+			panic("stack overflow");
+		}
+		f = &RT->frames[RT->fp++];
+		f->slots = &RT->stack[RT->sp];
+		RT->sp += num_slots;
+	}
+
+	// args may overlap the new slots, see the E_CALL case in eval()
+	memmove(f->slots, args, sizeof(Value) * num_args);
+	for (int i = num_args; i < num_slots; i++) {
+		f->slots[i] = (Value){.type = V_NONE};
+	}
+
+	f->up = up;
+	return f;
+}
+
+// (lambda ...) evaluates to a function value that refers to the frames
+// around it
+Value make_closure(Expr* l) {
+	Closure* c = rt_calloc(sizeof(Closure));
+
+	c->lambda = l;
+	c->env = RT->env;
+	c->func = (E_FuncData){
+		.name = l->lambda.name,
+		.name_len = strlen(l->lambda.name),
+		.num_args = l->lambda.num_params,
+		.return_type = V_NONE,
+		.actual_function = e_func_apply_closure,
+		.closure = c
+	};
+
+	return (Value){.type = V_FUNC, .func_value = &c->func};
+}
+
+// call a closure through the builtin interface, eg. from map or reduce
+Value e_func_apply_closure(Expr* e) {
+	Closure* c = e->func->closure;
+	Expr* l = c->lambda;
+	int num_args = e->num_kids;
+
+	Value args[num_args + 1];
+	for (int i = 0; i < num_args; i++) {
+		args[i] = eval(expr_arg(e, i));
+	}
+
+	int sp = RT->sp, fp = RT->fp;
+	Frame* env = RT->env;
+
+	RT->env = push_frame(l->lambda.num_slots, l->captured, args, num_args, c->env);
+
+	uint64_t start = trace_begin();
+	Value result = {.type = V_NONE};
+	for (uint32_t i = 0; i < l->num_kids; i++) {
+		result = eval(expr_arg(l, i));
+	}
+	if (RT->trace != NULL) {
+		trace_end(trace_name(l->lambda.name), start);
+	}
+
+	RT->sp = sp;
+	RT->fp = fp;
+	RT->env = env;
+	return result;
+}
+
+Value eval(Expr* e) {
+
+	if (++RT->depth > RT_MAX_DEPTH) {
+		panic("recursion too deep");
+	}
+	rt_charge(1);
+
+	// restored before returning, see the E_CALL case
+	int sp = RT->sp, fp = RT->fp;
+	Frame* env = RT->env;
+
+	// the closure call this eval() is in, when tracing, see the E_CALL case
+	const char* traced = NULL;
+	uint64_t traced_start = 0;
+
+	Value result;
+
+	for (;;) {
+		if (e->type == E_INT) {
+			result = (Value){.type = V_INT, .int_value = e->intlit};
+			break;
+		}
+
+		if (e->type == E_VAR) {
+			Frame* f = RT->env;
+			for (int d = e->var.depth; d > 0; d--) {
+				f = f->up;
+			}
+
+			result = f->slots[e->var.slot];
+			if (result.type == V_NONE) {
+				panic("variable %.*s used before it was defined",
+					e->var.name.len,
+					e->var.name.name);
+			}
+			break;
+		}
+
+		if (e->type == E_PARAM) {
+			if (e->param >= RT->num_params) {
+				panic("$%d is not bound", e->param);
+			}
+			result = (Value){.type = V_INT, .int_value = RT->params[e->param]};
+			break;
+		}
+
+		// parse() and func_apply_init() already checked the arg counts
+		if (e->type == E_FUNCCALL) {
+			E_FuncData* fd = &RT->builtins[e->fn];
+			if (RT->trace == NULL) {
+				result = fd->actual_function(e);
+			} else {
+				uint64_t start = trace_begin();
+				result = fd->actual_function(e);
+				trace_end(fd->name, start);
+			}
+			break;
+		}
+
+		if (e->type == E_APPLY) {
+			result = e->func->actual_function(e);
+			break;
+		}
+
+		if (e->type == E_VALUE) {
+			result = e->value;
+			break;
+		}
+
+		if (e->type == E_STRING) {
+			panic("\"%.*s\": a string can only be the argument of a builtin that takes one",
+				e->str.len, e->str.name);
+		}
+
+		if (e->type == E_DEFINE) {
+			result = eval(expr_arg(e, 0));
+			RT->env->slots[e->define.slot] = result;
+			break;
+		}
+
+		if (e->type == E_LAMBDA) {
+			result = make_closure(e);
+			break;
+		}
+
+		if (e->type == E_IF) {
+			Value cond = eval(expr_arg(e, 0));
+			if (cond.type != V_INT) {
+				panic("if: condition is type %s, expected int",
+					stringify_value_type(cond.type));
+			}
+			e = expr_arg(e, cond.int_value ? 1 : 2);
+			continue;
+		}
+
+		// the last expression of a body is in tail position. body is an
+		// E_SCOPE or E_LAMBDA
+		Expr* body;
+
+		if (e->type == E_SCOPE) {
+			body = e;
+			RT->env = push_frame(e->scope.num_slots, e->captured, NULL, 0, RT->env);
+
+		} else if (e->type == E_CALL) {
+			Value fv = eval(expr_arg(e, 0));
+			if (fv.type != V_FUNC) {
+				panic("called a value of type %s, expected function",
+					stringify_value_type(fv.type));
+			}
+
+			int num_args = e->num_kids - 1;
+			E_FuncData* fd = fv.func_value;
+			if (fd->num_args != RTFN_VARARGS && fd->num_args != num_args) {
+				panic("%s: expected %d arguments, got %d",
+					fd->name,
+					fd->num_args,
+					num_args);
+			}
+
+			if (fd->closure == NULL) {
+				// a builtin passed around as a value. its children have to
+				// be right before the call, so the args are evaluated into
+				// a new block of E_VALUEs first
+				Expr* call = rt_calloc(sizeof(Expr) * (num_args + 1));
+				for (int i = 0; i < num_args; i++) {
+					call[i] = (Expr){.type = E_VALUE, .value = eval(expr_arg(e, i + 1))};
+				}
+				call[num_args] = (Expr){
+					.type = E_APPLY,
+					.num_kids = num_args,
+					.kids = num_args,
+					.func = fd
+				};
+				result = fd->actual_function(&call[num_args]);
+				rt_free(call);
+				break;
+			}
+
+			// evaluate the args on top of the stack, then drop everything
+			// this eval() pushed before them
+			if (RT->stack == NULL) {
+				rt_stack_init(RT);
+			}
+			if (RT->sp + num_args > RT->stack_cap) {
+				panic("stack overflow");
+			}
+
+			Value* args = &RT->stack[RT->sp];
+			for (int i = 0; i < num_args; i++) {
+				Value v = eval(expr_arg(e, i + 1));
+				args[i] = v;
+				RT->sp++;
+			}
+
+			Closure* c = fd->closure;
+			RT->sp = sp;
+			RT->fp = fp;
+
+			if (RT->trace != NULL) {
+				// a tail call ends the call it replaces
+				if (traced != NULL) {
+					trace_end(traced, traced_start);
+				}
+				traced = trace_name(c->lambda->lambda.name);
+				traced_start = trace_begin();
+			}
+
+			body = c->lambda;
+			RT->env = push_frame(body->lambda.num_slots, body->captured, args, num_args, c->env);
+
+		} else {
+			panic("eval: unknown expression type %d", e->type);
+		}
+
+		for (uint32_t i = 0; i + 1 < body->num_kids; i++) {
+			eval(expr_arg(body, i));
+		}
+		e = expr_arg(body, body->num_kids - 1);
+	}
+
+	if (traced != NULL) {
+		trace_end(traced, traced_start);
+	}
+
+	RT->sp = sp;
+	RT->fp = fp;
+	RT->env = env;
+	RT->depth--;
+	return result;
+}
+
+/*	columnar evaluation: lisp_eval_batch() evaluates one program for many
+	rows of inputs. a program that is a single expression of ints, $n, if
+	and builtins with a vec_function is turned into a VecPlan, one step per
+	node, and evaluated VEC_BLOCK rows at a time. each step fills a column
+	of the block with one loop over VecInts, which the compiler turns into
+	SIMD instructions, so the cost of dispatching on the node is paid once
+	per block instead of once per row. other programs, and any block a
+	vec_function gives up on, are evaluated row by row with eval() */
+
+#define VEC_BLOCK 1024
+#define VEC_LANES ((int)(sizeof(VecInt) / sizeof(int)))
+
+// defines a vec_function, and on x86-64 a copy of it built for AVX2.
+// vec_select() picks the one this cpu can run
+#if defined(__x86_64__)
+#define VEC_FUNC(name, ...) \
+	bool name(VecInt* out, VecInt** args, int n) __VA_ARGS__ \
+	__attribute__((target("avx2"))) \
+	bool name##_avx2(VecInt* out, VecInt** args, int n) __VA_ARGS__
+
+#define vec_select(name) \
+	(__builtin_cpu_supports("avx2") ? name##_avx2 : name)
+#else
+#define VEC_FUNC(name, ...) \
+	bool name(VecInt* out, VecInt** args, int n) __VA_ARGS__
+
+#define vec_select(name) \
+	(name)
+#endif
+
+// vector comparisons give -1 for true, the builtins give 1
+#define VEC_FUNC_1(name, expr) \
+	VEC_FUNC(name, { \
+		for (int i = 0; i < n; i++) { \
+			VecInt x = args[0][i]; \
+			out[i] = (expr); \
+		} \
+		return true; \
+	})
+
+#define VEC_FUNC_2(name, expr) \
+	VEC_FUNC(name, { \
+		for (int i = 0; i < n; i++) { \
+			VecInt x = args[0][i], y = args[1][i]; \
+			out[i] = (expr); \
+		} \
+		return true; \
+	})
+
+VEC_FUNC_2(vec_func_add, x + y)
+VEC_FUNC_2(vec_func_sub, x - y)
+VEC_FUNC_2(vec_func_mul, x * y)
+VEC_FUNC_2(vec_func_eq, -(x == y))
+VEC_FUNC_2(vec_func_neq, -(x != y))
+VEC_FUNC_2(vec_func_lt, -(x < y))
+VEC_FUNC_2(vec_func_gt, -(x > y))
+VEC_FUNC_2(vec_func_le, -(x <= y))
+VEC_FUNC_2(vec_func_ge, -(x >= y))
+VEC_FUNC_1(vec_func_bool, -(x != 0))
+VEC_FUNC_1(vec_func_sq, x * x)
+VEC_FUNC_1(vec_func_odd, x & 1)
+VEC_FUNC_1(vec_func_even, 1 - (x & 1))
+
+// % traps on a divisor of 0 (and INT_MIN % -1), leave those to e_func_mod
+VEC_FUNC(vec_func_mod, {
+	for (int i = 0; i < n; i++) {
+		VecInt y = args[1][i];
+		for (int j = 0; j < VEC_LANES; j++) {
+			if (y[j] == 0 || y[j] == -1) {
+				return false;
+			}
+		}
+		out[i] = args[0][i] % y;
+	}
+	return true;
+})
+
+// (if c t f) with both branches already evaluated
+VEC_FUNC(vec_if, {
+	for (int i = 0; i < n; i++) {
+		VecInt mask = args[0][i] != 0;
+		out[i] = (args[1][i] & mask) | (args[2][i] & ~mask);
+	}
+	return true;
+})
+
+typedef enum {
+	VS_CONST,
+	VS_PARAM,
+	VS_FUNC
+} VecStepType;
+
+// fills column i of the block for the i-th step, args are earlier steps
+typedef struct {
+	VecStepType type;
+	int args[3];
+	union {
+		int constant;
+		int param;
+		E_VecFunc* fn;
+	};
+} VecStep;
+
+typedef struct {
+	VecStep* steps;
+	int num_steps;
+} VecPlan;
+
+// append the steps for e and everything below it. the index of the step
+// with e's value, or -1 if e can't be evaluated by columns. each constant
+// and $n gets a single step, however often it is used
+int vec_plan_add(VecPlan* p, Expr* e) {
+	VecStep s = {0};
+
+	if (e->type == E_INT) {
+		s.type = VS_CONST;
+		s.constant = e->intlit;
+	} else if (e->type == E_VALUE && e->value.type == V_INT) {
+		s.type = VS_CONST;
+		s.constant = e->value.int_value;
+	} else if (e->type == E_PARAM) {
+		s.type = VS_PARAM;
+		s.param = e->param;
+	} else if ((e->type == E_FUNCCALL && RT->builtins[e->fn].vec_function != NULL)
+	|| e->type == E_IF) {
+		// every vec_function takes and returns ints, so the types of the
+		// args need no checking
+		for (uint32_t i = 0; i < e->num_kids; i++) {
+			s.args[i] = vec_plan_add(p, expr_arg(e, i));
+			if (s.args[i] < 0) {
+				return -1;
+			}
+		}
+		s.type = VS_FUNC;
+		s.fn = e->type == E_IF ? RT->ctx->vec_if : RT->builtins[e->fn].vec_function;
+	} else {
+		return -1;
+	}
+
+	if (s.type != VS_FUNC) {
+		for (int i = 0; i < p->num_steps; i++) {
+			if (p->steps[i].type == s.type && p->steps[i].constant == s.constant) {
+				return i;
+			}
+		}
+	}
+
+	p->num_steps++;
+	p->steps = rt_realloc(p->steps, sizeof(VecStep) * p->num_steps);
+	p->steps[p->num_steps - 1] = s;
+	return p->num_steps - 1;
+}
+
+// evaluate rows [lo, hi) one at a time
+void eval_rows(Expr* root, const int* const* cols, int num_cols, int lo, int hi, int* out) {
+	int params[num_cols + 1];
+	RT->params = params;
+	RT->num_params = num_cols;
+
+	for (int r = lo; r < hi; r++) {
+		for (int i = 0; i < num_cols; i++) {
+			params[i] = cols[i][r];
+		}
+
+		Value v = eval(root);
+		if (v.type != V_INT) {
+			panic("row %d: result is type %s, expected int",
+				r,
+				stringify_value_type(v.type));
+		}
+		out[r] = v.int_value;
+
+		// nothing is kept from one row to the next, not even the files
+		// load-ints mapped for it (RT->heap is the ctx's eval_heap)
+		free_results(RT->ctx);
+	}
+}
+
+// the plan and its columns go on scratch, eval_rows() clears RT->heap
+void eval_batch(Expr* root, Heap* scratch, const int* const* cols, int num_cols, int num_rows, int* out) {
+	Heap* heap = RT->heap;
+	RT->heap = scratch;
+
+	// the top level of the program has to be a single expression
+	VecPlan p = {0};
+	int result = -1;
+	if (root->scope.num_slots == 0 && root->num_kids == 1) {
+		result = vec_plan_add(&p, expr_arg(root, 0));
+	}
+	if (result < 0) {
+		p.num_steps = 0;
+	}
+
+	VecInt* block = NULL;
+	if (result >= 0) {
+		block = rt_alloc(sizeof(int) * VEC_BLOCK * p.num_steps + sizeof(VecInt));
+		if (block == NULL) {
+			panic("out of memory");
+		}
+		block = (VecInt*)(((uintptr_t)block + sizeof(VecInt) - 1) & ~(sizeof(VecInt) - 1));
+	}
+	RT->heap = heap;
+
+	#define vec_col(i) \
+		(block + (size_t)(i) * (VEC_BLOCK / VEC_LANES))
+
+	for (int i = 0; i < p.num_steps; i++) {
+		if (p.steps[i].type == VS_CONST) {
+			int* col = (int*)vec_col(i);
+			for (int j = 0; j < VEC_BLOCK; j++) {
+				col[j] = p.steps[i].constant;
+			}
+		}
+	}
+
+	for (int lo = 0; lo < num_rows; lo += VEC_BLOCK) {
+		int n = num_rows - lo < VEC_BLOCK ? num_rows - lo : VEC_BLOCK;
+		int num_vecs = (n + VEC_LANES - 1) / VEC_LANES;
+		bool done = result >= 0;
+
+		for (int i = 0; done && i < p.num_steps; i++) {
+			VecStep* s = &p.steps[i];
+			VecInt* col = vec_col(i);
+
+			if (s->type == VS_PARAM) {
+				// the lanes past the last row get 1s, which no builtin
+				// gives up on
+				int* c = (int*)col;
+				memcpy(c, cols[s->param] + lo, sizeof(int) * n);
+				for (int j = n; j < num_vecs * VEC_LANES; j++) {
+					c[j] = 1;
+				}
+			} else if (s->type == VS_FUNC) {
+				VecInt* args[3] = {vec_col(s->args[0]), vec_col(s->args[1]), vec_col(s->args[2])};
+				done = s->fn(col, args, num_vecs);
+			}
+		}
+
+		if (done) {
+			memcpy(out + lo, vec_col(result), sizeof(int) * n);
+			rt_charge((int64_t)n * p.num_steps);
+		} else {
+			eval_rows(root, cols, num_cols, lo, lo + n, out);
+		}
+	}
+
+	#undef vec_col
+}
+
+/*
+	TODO
+	- make sure parens are balanced and token list is well formed
+	- ast edge cases?
+	- "or" and "and" functions for list of bools
+	- remaining math+comparison functions
+	- specific types for bool and float
+	- printing types ("list of bool") or type representation
+		- maybe (type mylist (list bool))
+	- string types and string literals
+	- reading from a file/command line interface and help messages
+	- repl mode
+	- better error messages
+
+	
+
+	language currently supports:
+
+	- builtin types:
+		- ints, or just integer literals that fit into standard C int type
+		- lists of int literals
+		- TODO boolean constants #true and #false
+
+	- constants which always start with a #, but it's not a reserved character
+
+	- variables, with lexical scope
+		(define name value) - bind name in the current scope, returns value
+		(let ((name value) ...) body ...) - bind names in a new scope, then
+			evaluate body and return its last value. each value can use the
+			names before it
+	  a program can have several top level forms, its result is the last one
+		(define n 10) (sum (range 0 n))
+
+	- functions
+		(lambda (params ...) body ...) - a function value
+		(defun name (params ...) body ...) - (define name (lambda ...)), and
+			can be called by functions defined before it in the same body
+		(f args ...) - call a function value, eg. a variable or lambda
+	  functions can be passed to map/filter/reduce like builtins. calls in
+	  tail position don't use any stack, so loops can be written as
+		(defun count (n acc) (if (= n 0) acc (count (- n 1) (+ acc 1))))
+
+	- inputs: $0, $1, ... are ints given to lisp_eval_params(), or one row
+	  of columns given to lisp_eval_batch() (see eval_batch)
+		(+ (* $0 $0) $1)
+
+	- ability to do function calls with prefix notation similar to lisp
+		(+ 5 6) = 11
+
+	- builtin functions:
+
+		- arithmetic operators, all are (int, int) -> int
+			(+ x y)
+			(- x y)
+			(* x y)
+			(% x y)
+
+		- comparison operators, all are (int, int) -> int
+			(= x y)
+			(!= x y)
+			(< x y)
+			(<= x y)
+			(> x y)
+			(>= x y)
+
+		- type conversion
+			(bool x) - convert a number to 0 or 1 (equivalent to `!!x` in C)
+
+		- list operations
+			(list ...) - construct a list of ints
+			(len l) - get the length of a list
+			(sum l) - sum up a list of ints
+			(range start stop) - construct a list of ints in range [start, stop)
+			(map f l) - apply f to each element of l
+			(filter f l) - keep the elements of l where (f x) is nonzero
+			(reduce f init l) - fold l from the left with (f acc x)
+			(take n l) - the first n elements of l
+			(min l), (max l) - smallest/largest element of a non-empty list
+			(nth i l) - the element at index i, in O(1)
+			(slice lo hi l) - elements [lo, hi) of l, without copying them
+			(push x l) - l with x added at the end
+			(concat a b) - the elements of a, then those of b
+
+		  lists are immutable and share their elements (see VecHeader), so
+		  building a list with push or concat takes amortized O(1) per
+		  element, and the list pushed to is still there afterwards
+
+		  f is a builtin name or function value, eg. (sum (map sq (filter odd l))).
+		  chains of map/filter/take/range are fused into a single loop when
+		  consumed by sum/len/reduce, so no intermediate lists are built
+		  (see Seq). sum/len/min/max over long inputs are split across
+		  --threads threads (see reduce_arg)
+
+		- maps from ints to ints
+			(map-new) - an empty map
+			(put k v m) - m with k set to v
+			(get k m) - the value of k in m, an error if m doesn't have it
+			(has k m) - 1 if m has k, else 0
+			(map-len m) - the number of keys in m
+
+		  like lists, maps are immutable and share their entries (see
+		  MapTable). get, has and put on the newest version of a map are
+		  O(1), an older version pays for the puts made after it
+
+		- files
+			(load-ints "path") - a file of little-endian int32s as a list
+			(load-ints64 "path") - the same for int64s, each of which has
+			  to fit in an int once it's used
+
+		  the file is mapped, not read: pages are read in as the list is
+		  used, and sum/len/min/max let go of them as they go, so lists
+		  larger than memory work. "path" is a string literal, the only
+		  place one can appear
+
+		- int helpers, mostly useful as arguments to map/filter
+			(sq x) - x * x
+			(odd x), (even x)
+
+		- logic
+			(if cond then else) - only evaluates the branch it returns
+
+		- other
+			(fib n) - compute nth fibonacci number
+
+*/
+
+#define rt_add_constant(ctx, name_cstrlit, ...) \
+	rt_varlist_append((ctx)->constants, (VarData){ \
+		.name=(name_cstrlit), \
+		.value=(__VA_ARGS__) \
+	})
+
+// declare a runtime function (without having to specify name len separately)
+// the ... is the list of return types so you can pass like {V_INT, V_LIST, V_INT, ...}
+// for varargs all of the varargs will be evaluated as the last type in the list
+// and num_args should be the number of REQUIRED (aka non-vararg) arguments, 
+// which can be 0
+#define rt_add_func(ctx, name_cstrlit, actual_func_ptr, \
+func_ret_type, func_arg_count, ...) \
+	rt_fnlist_append((ctx)->builtins, (E_FuncData){ \
+		.name = (name_cstrlit), \
+		.name_len = strlen(name_cstrlit), \
+		.num_args = (func_arg_count == RTFN_VARARGS \
+			? RTFN_VARARGS \
+			: (int) (sizeof((ValueType[]) __VA_ARGS__) / sizeof(ValueType))), \
+		.arg_types = ((ValueType[]) __VA_ARGS__), \
+		.return_type = func_ret_type, \
+		.actual_function = (actual_func_ptr) \
+	})
+
+// give the builtin added last a column version, see eval_batch()
+#define rt_add_vec_func(ctx, vec_func_ptr) \
+	((ctx)->builtins.fns[(ctx)->builtins.num_fns - 1].vec_function = (vec_func_ptr))
+
+// mark the builtin added last as depending on more than its args, see
+// expr_pure()
+#define rt_set_impure(ctx) \
+	((ctx)->builtins.fns[(ctx)->builtins.num_fns - 1].impure = true)
+
+void rt_init(lisp_ctx* ctx) {
+
+	ctx->constants = rt_varlist_new();
+
+	rt_add_constant(ctx, "#false", (Value){.type=V_INT, .int_value=0});
+	rt_add_constant(ctx, "#true", (Value){.type=V_INT, .int_value=1});
+
+	ctx->builtins = rt_fnlist_new();
+	ctx->vec_if = vec_select(vec_if);
+
+	rt_add_func(ctx, "+", e_func_add, V_INT, 2, {V_INT, V_INT});
+	rt_add_vec_func(ctx, vec_select(vec_func_add));
+	rt_add_func(ctx, "-", e_func_sub, V_INT, 2, {V_INT, V_INT});
+	rt_add_vec_func(ctx, vec_select(vec_func_sub));
+	rt_add_func(ctx, "*", e_func_mul, V_INT, 2, {V_INT, V_INT});
+	rt_add_vec_func(ctx, vec_select(vec_func_mul));
+	rt_add_func(ctx, "%", e_func_mod, V_INT, 2, {V_INT, V_INT});
+	rt_add_vec_func(ctx, vec_select(vec_func_mod));
+	rt_add_func(ctx, "=", e_func_eq, V_INT, 2, {V_INT, V_INT});
+	rt_add_vec_func(ctx, vec_select(vec_func_eq));
+	rt_add_func(ctx, "!=", e_func_neq, V_INT, 2, {V_INT, V_INT});
+	rt_add_vec_func(ctx, vec_select(vec_func_neq));
+	rt_add_func(ctx, ">", e_func_gt, V_INT, 2, {V_INT, V_INT});
+	rt_add_vec_func(ctx, vec_select(vec_func_gt));
+	rt_add_func(ctx, "<=", e_func_le, V_INT, 2, {V_INT, V_INT});
+	rt_add_vec_func(ctx, vec_select(vec_func_le));
+	rt_add_func(ctx, "<", e_func_lt, V_INT, 2, {V_INT, V_INT});
+	rt_add_vec_func(ctx, vec_select(vec_func_lt));
+	rt_add_func(ctx, ">=", e_func_ge, V_INT, 2, {V_INT, V_INT});
+	rt_add_vec_func(ctx, vec_select(vec_func_ge));
+	rt_add_func(ctx, "bool", e_func_bool, V_INT, 1, {V_INT});
+	rt_add_vec_func(ctx, vec_select(vec_func_bool));
+	rt_add_func(ctx, "fib", e_func_fib, V_INT, 1, {V_INT});
+	rt_add_func(ctx, "list", e_func_list, V_LIST, RTFN_VARARGS, {});
+	rt_add_func(ctx, "len", e_func_len, V_INT, 1, {V_LIST});
+	rt_add_func(ctx, "sum", e_func_sum, V_INT, 1, {V_LIST});
+	rt_add_func(ctx, "min", e_func_min, V_INT, 1, {V_LIST});
+	rt_add_func(ctx, "max", e_func_max, V_INT, 1, {V_LIST});
+	rt_add_func(ctx, "range", e_func_range, V_LIST, 2, {V_INT, V_INT});
+	rt_add_func(ctx, "map", e_func_map, V_LIST, 2, {V_FUNC, V_LIST});
+	rt_add_func(ctx, "filter", e_func_filter, V_LIST, 2, {V_FUNC, V_LIST});
+	rt_add_func(ctx, "reduce", e_func_reduce, V_INT, 3, {V_FUNC, V_INT, V_LIST});
+	rt_add_func(ctx, "take", e_func_take, V_LIST, 2, {V_INT, V_LIST});
+	rt_add_func(ctx, "nth", e_func_nth, V_INT, 2, {V_INT, V_LIST});
+	rt_add_func(ctx, "slice", e_func_slice, V_LIST, 3, {V_INT, V_INT, V_LIST});
+	rt_add_func(ctx, "push", e_func_push, V_LIST, 2, {V_INT, V_LIST});
+	rt_add_func(ctx, "concat", e_func_concat, V_LIST, 2, {V_LIST, V_LIST});
+	// the argument is a string literal, which isn't a Value
+	rt_add_func(ctx, "load-ints", e_func_load_ints, V_LIST, 1, {V_NONE});
+	rt_set_impure(ctx);
+	rt_add_func(ctx, "load-ints64", e_func_load_ints64, V_LIST, 1, {V_NONE});
+	rt_set_impure(ctx);
+	rt_add_func(ctx, "map-new", e_func_map_new, V_MAP, 0, {});
+	rt_add_func(ctx, "put", e_func_put, V_MAP, 3, {V_INT, V_INT, V_MAP});
+	rt_add_func(ctx, "get", e_func_get, V_INT, 2, {V_INT, V_MAP});
+	rt_add_func(ctx, "has", e_func_has, V_INT, 2, {V_INT, V_MAP});
+	rt_add_func(ctx, "map-len", e_func_map_len, V_INT, 1, {V_MAP});
+	rt_add_func(ctx, "sq", e_func_sq, V_INT, 1, {V_INT});
+	rt_add_vec_func(ctx, vec_select(vec_func_sq));
+	rt_add_func(ctx, "odd", e_func_odd, V_INT, 1, {V_INT});
+	rt_add_vec_func(ctx, vec_select(vec_func_odd));
+	rt_add_func(ctx, "even", e_func_even, V_INT, 1, {V_INT});
+	rt_add_vec_func(ctx, vec_select(vec_func_even));
+}
+
+/*	native builtins: lisp_add_builtin() appends to ctx->builtins like
+	rt_add_func() does, so parse() resolves them by name and eval() calls
+	them through the same E_FuncData as the ones above. lisp_call is just
+	the Expr of the call, and these are what a builtin outside lisp.c
+	has instead of try_eval_arg_as_type() and the Expr macros */
+
+// panics unless call has an argument i
+void call_check_arg(lisp_call* call, int i) {
+	if (i < 0 || i >= (int)call->num_kids) {
+		E_FuncData* fd = expr_func(call);
+		panic("%.*s: no argument %d", fd->name_len, fd->name, i);
+	}
+}
+
+int lisp_num_args(lisp_call* call) {
+	return call->num_kids;
+}
+
+Value lisp_arg(lisp_call* call, int i) {
+	call_check_arg(call, i);
+	return eval(expr_arg(call, i));
+}
+
+int lisp_arg_int(lisp_call* call, int i) {
+	call_check_arg(call, i);
+	return try_eval_arg_as_type(call, i, V_INT).int_value;
+}
+
+ValueList lisp_arg_list(lisp_call* call, int i) {
+	call_check_arg(call, i);
+	return try_eval_arg_as_type(call, i, V_LIST).list_value;
+}
+
+const char* lisp_arg_string(lisp_call* call, int i) {
+	call_check_arg(call, i);
+	return expr_string_arg(call, i);
+}
+
+ValueList lisp_new_list(int num_values) {
+	if (num_values < 0) {
+		panic("list too long");
+	}
+	if (num_values == 0) {
+		return vl_new();
+	}
+	rt_charge(num_values);
+	ValueList l = vl_copy(vl_new(), num_values);
+	l.num_values = num_values;
+	vl_header(l)->used = num_values;
+	return l;
+}
+
+void lisp_charge(long steps) {
+	rt_charge(steps);
+}
+
+_Noreturn void lisp_raise(const char* fmt, ...) {
+	char msg[RT_ERROR_MAX];
+	va_list ap;
+	va_start(ap, fmt);
+	vsnprintf(msg, sizeof(msg), fmt, ap);
+	va_end(ap);
+	panic("%s", msg);
+}
+
+/*	parallel front end: a long program is cut into chunks at the top
+	level, and each chunk is tokenized and turned into ast nodes on the
+	thread pool. the cuts come from a prescan that only counts parens and
+	quotes: each range of the source reports its net change in depth for
+	both ways it could start, outside a string or inside one, a prefix sum
+	picks one and turns those into the depth at the start of every range,
+	and from there each range looks for its first byte at depth 0 and
+	outside a string that can't be inside an atom.
+	parse() still runs on the calling thread over the merged forms, since
+	which names a form can see depends on every form before it */
+
+// bytes per chunk, at least. shorter programs are done on one thread
+#define PAR_FRONTEND_CHUNK (1 << 20)
+
+typedef struct {
+	lisp_ctx* ctx;
+	char* text;
+	size_t len;
+	int num_chunks;
+
+	// for each range starting outside [0] or inside [1] a string: the net
+	// change in depth over it and the lowest depth reached, relative to
+	// its start. and whether it has an odd number of quotes
+	int (*net)[2];
+	int (*low)[2];
+	bool* odd_quotes;
+
+	// the depth at the start of each range, and if it's inside a string
+	int* depth;
+	bool* in_string;
+	size_t* cuts; // chunk i is text[cuts[i]..cuts[i + 1])
+
+	// each chunk allocates from its own heap, which ends up in the caller's
+	Heap* heaps;
+	HeapBlock** tails;
+	ASTNode** forms;
+
+	// the error each chunk raised, or "". the calling thread re-raises the
+	// first one in the source, so that it doesn't depend on timing
+	char (*errors)[RT_ERROR_MAX];
+} ParFrontend;
+
+size_t par_range_start(ParFrontend* pf, int i) {
+	return pf->len * i / pf->num_chunks;
+}
+
+void par_depth_range(void* arg, int i) {
+	ParFrontend* pf = arg;
+	const char* s = pf->text;
+	size_t hi = par_range_start(pf, i + 1);
+
+	// a paren counts for the range starting outside a string exactly when
+	// it doesn't for the one starting inside
+	int depth[2] = {0, 0}, low[2] = {0, 0};
+	bool in = false;
+	for (size_t p = par_range_start(pf, i); p < hi; p++) {
+		if (s[p] == '"') {
+			in = !in;
+		} else if (s[p] == '(' || s[p] == ')') {
+			depth[in] += s[p] == '(' ? 1 : -1;
+			low[in] = depth[in] < low[in] ? depth[in] : low[in];
+		}
+	}
+	memcpy(pf->net[i], depth, sizeof(depth));
+	memcpy(pf->low[i], low, sizeof(low));
+	pf->odd_quotes[i] = in;
+}
+
+// the first place at or after the start of range i where a chunk can
+// begin: at depth 0 outside a string, right after whitespace or a ')'. it
+// may be in a later range, or the end if one form runs to the end
+void par_find_cut(void* arg, int i) {
+	ParFrontend* pf = arg;
+	const char* s = pf->text;
+	int depth = pf->depth[i];
+	bool in = pf->in_string[i];
+
+	size_t p = par_range_start(pf, i);
+	if (p == 0) {
+		pf->cuts[i] = 0;
+		return;
+	}
+	for (; p < pf->len; p++) {
+		unsigned char c = s[p - 1];
+		if (depth == 0 && !in && (c == ' ' || (c >= '\t' && c <= '\r') || c == ')')) {
+			break;
+		}
+		if (s[p] == '"') {
+			in = !in;
+		} else if (!in) {
+			depth += (s[p] == '(') - (s[p] == ')');
+		}
+	}
+	pf->cuts[i] = p;
+}
+
+void par_frontend_chunk(void* arg, int i) {
+	ParFrontend* pf = arg;
+	Heap* heap = &pf->heaps[i];
+
+	// chunks run with their own state, even on the calling thread
+	RT_State* saved = RT;
+	jmp_buf on_error;
+	char error[RT_ERROR_MAX];
+	RT_State state = {
+		.ctx = pf->ctx,
+		.builtins = pf->ctx->builtins.fns,
+		.heap = heap,
+		.on_error = &on_error,
+		.error = error
+	};
+	RT = &state;
+
+	if (setjmp(on_error) == 0) {
+		ASTNode* forms = node_new();
+		forms->type = A_LIST;
+		append_ast_forms(forms, tokenize(pf->text + pf->cuts[i], pf->cuts[i + 1] - pf->cuts[i]));
+		pf->forms[i] = forms;
+		pf->tails[i] = heap_tail(heap);
+	} else {
+		heap_free_all(heap);
+		memcpy(pf->errors[i], error, RT_ERROR_MAX);
+	}
+
+	RT = saved;
+}
+
+// make_ast_forms(tokenize(text, len)) on the thread pool, or NULL if
+// the program is too short for that or its parens don't balance, which
+// the serial version reports better
+ASTNode* par_make_ast_forms(char* text, size_t len) {
+
+	lisp_ctx* ctx = RT->ctx;
+	if (ctx->num_threads < 2 || len < 2 * PAR_FRONTEND_CHUNK) {
+		return NULL;
+	}
+	if (ctx->pool == NULL) {
+		ctx->pool = pool_new(ctx->num_threads - 1);
+	}
+
+	// a few chunks per thread, so one slow chunk doesn't hold up the rest
+	size_t num_chunks = len / PAR_FRONTEND_CHUNK;
+	if (num_chunks > (size_t)ctx->num_threads * 4) {
+		num_chunks = ctx->num_threads * 4;
+	}
+
+	ParFrontend pf = {
+		.ctx = ctx,
+		.text = text,
+		.len = len,
+		.num_chunks = num_chunks,
+		.net = rt_alloc(sizeof(int[2]) * num_chunks),
+		.low = rt_alloc(sizeof(int[2]) * num_chunks),
+		.odd_quotes = rt_alloc(sizeof(bool) * num_chunks),
+		.depth = rt_alloc(sizeof(int) * num_chunks),
+		.in_string = rt_alloc(sizeof(bool) * num_chunks),
+		.cuts = rt_alloc(sizeof(size_t) * (num_chunks + 1)),
+		.heaps = rt_calloc(sizeof(Heap) * num_chunks),
+		.tails = rt_calloc(sizeof(HeapBlock*) * num_chunks),
+		.forms = rt_calloc(sizeof(ASTNode*) * num_chunks),
+		.errors = rt_calloc(RT_ERROR_MAX * num_chunks)
+	};
+	if (pf.net == NULL || pf.low == NULL || pf.odd_quotes == NULL
+	|| pf.depth == NULL || pf.in_string == NULL || pf.cuts == NULL
+	|| pf.heaps == NULL || pf.tails == NULL || pf.forms == NULL
+	|| pf.errors == NULL) {
+		panic("out of memory");
+	}
+
+	uint64_t start = trace_begin();
+	pool_run(ctx->pool, par_depth_range, &pf, num_chunks);
+
+	// an unterminated string also leaves it to the serial path to report
+	int depth = 0;
+	bool in = false;
+	bool balanced = true;
+	for (int i = 0; i < pf.num_chunks; i++) {
+		balanced &= depth + pf.low[i][in] >= 0;
+		pf.depth[i] = depth;
+		pf.in_string[i] = in;
+		depth += pf.net[i][in];
+		in ^= pf.odd_quotes[i];
+	}
+	balanced &= !in;
+
+	if (balanced && depth == 0) {
+		pool_run(ctx->pool, par_find_cut, &pf, num_chunks);
+		pf.cuts[num_chunks] = len;
+	}
+	trace_end("prescan", start);
+
+	if (!balanced || depth != 0) {
+		return NULL;
+	}
+
+	start = trace_begin();
+	pool_run(ctx->pool, par_frontend_chunk, &pf, num_chunks);
+
+	// the chunks' tokens and nodes go where the serial version puts them
+	for (int i = 0; i < pf.num_chunks; i++) {
+		heap_splice(RT->heap, &pf.heaps[i], pf.tails[i]);
+	}
+	for (int i = 0; i < pf.num_chunks; i++) {
+		if (pf.errors[i][0] != '\0') {
+			rt_raise("%s", pf.errors[i]);
+		}
+	}
+
+	// merged in source order
+	int num_forms = 0;
+	for (int i = 0; i < pf.num_chunks; i++) {
+		num_forms += pf.forms[i]->list_len;
+	}
+	if (num_forms == 0) {
+		panic("parse error: empty program");
+	}
+
+	ASTNode* forms = node_new();
+	forms->type = A_LIST;
+	list_resize(forms, num_forms);
+	ASTNode** item = forms->list_items;
+	for (int i = 0; i < pf.num_chunks; i++) {
+		memcpy(item, pf.forms[i]->list_items, sizeof(ASTNode*) * pf.forms[i]->list_len);
+		item += pf.forms[i]->list_len;
+	}
+	trace_end("tokenize+make_ast", start);
+
+	return forms;
+}
+
+// library interface, see lisp.h
+
+lisp_ctx* lisp_ctx_new(void) {
+	lisp_ctx* ctx = calloc(1, sizeof(lisp_ctx));
+	ctx->fuse = true;
+	ctx->num_threads = 1;
+	ctx->par_threshold = 1 << 16;
+	pthread_mutex_init(&ctx->mappings_lock, NULL);
+	rt_init(ctx);
+	return ctx;
+}
+
+void lisp_ctx_free(lisp_ctx* ctx) {
+	if (ctx->pool != NULL) {
+		pool_free(ctx->pool);
+	}
+	free_results(ctx);
+	lisp_set_trace(ctx, 0);
+	lisp_set_cache(ctx, 0, 0);
+	if (ctx->last_prog != NULL) {
+		lisp_prog_free(ctx->last_prog);
+	}
+	free(ctx->stack);
+	free(ctx->frames);
+	free(ctx->builtins.fns);
+	free(ctx->constants.vars);
+	for (int i = 0; i < ctx->num_plugins; i++) {
+		dlclose(ctx->plugins[i]);
+	}
+	free(ctx->plugins);
+	pthread_mutex_destroy(&ctx->mappings_lock);
+	free(ctx);
+}
+
+void lisp_set_threads(lisp_ctx* ctx, int num_threads, int par_threshold) {
+	if (ctx->pool != NULL) {
+		pool_free(ctx->pool);
+		ctx->pool = NULL;
+	}
+	ctx->num_threads = num_threads < 1 ? 1 : num_threads;
+	ctx->par_threshold = par_threshold;
+}
+
+void lisp_set_fuse(lisp_ctx* ctx, bool fuse) {
+	ctx->fuse = fuse;
+}
+
+// fail a call on ctx that isn't compiling or evaluating, see lisp_error()
+int ctx_fail(lisp_ctx* ctx, const char* fmt, ...) {
+	va_list ap;
+	va_start(ap, fmt);
+	vsnprintf(ctx->error, RT_ERROR_MAX, fmt, ap);
+	va_end(ap);
+	return -1;
+}
+
+int lisp_add_builtin(lisp_ctx* ctx, const lisp_builtin* builtin) {
+	const char* name = builtin->name;
+	size_t len = strlen(name);
+
+	if (ctx->compiled) {
+		return ctx_fail(ctx, "builtin: %s: something was compiled on this context already", name);
+	}
+
+	// anything else would parse as something other than a name
+	bool ok = len > 0 && len < INT_MAX && name[0] != '$' && name[0] != '#'
+		&& !isdigit((unsigned char)name[0])
+		&& !(name[0] == '-' && isdigit((unsigned char)name[1]));
+	for (const char* c = name; *c != '\0'; c++) {
+		ok &= !isspace((unsigned char)*c) && *c != '(' && *c != ')' && *c != '"';
+	}
+	static const char* forms[] = {"define", "defun", "let", "lambda", "if"};
+	for (size_t i = 0; i < sizeof(forms) / sizeof(forms[0]); i++) {
+		ok &= strcmp(name, forms[i]) != 0;
+	}
+	if (!ok) {
+		return ctx_fail(ctx, "builtin: bad name \"%s\"", name);
+	}
+	for (int i = 0; i < ctx->builtins.num_fns; i++) {
+		E_FuncData* fd = &ctx->builtins.fns[i];
+		if (fd->name_len == (int)len && !strncmp(name, fd->name, len)) {
+			return ctx_fail(ctx, "builtin: %s is taken", name);
+		}
+	}
+	if (builtin->fn == NULL
+	|| (builtin->num_args != LISP_VARARGS && (builtin->num_args < 0 || builtin->arg_types == NULL))) {
+		return ctx_fail(ctx, "builtin: %s has no function or arg types", name);
+	}
+
+	rt_fnlist_append(ctx->builtins, {
+		.name = (char*)name,
+		.name_len = len,
+		.num_args = builtin->num_args,
+		.arg_types = (ValueType*)builtin->arg_types,
+		.return_type = builtin->return_type,
+		.actual_function = builtin->fn,
+		.impure = builtin->impure
+	});
+	return 0;
+}
+
+int lisp_load_plugin(lisp_ctx* ctx, const char* path) {
+	if (ctx->compiled) {
+		return ctx_fail(ctx, "plugin: %s: something was compiled on this context already", path);
+	}
+
+	void* handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+	if (handle == NULL) {
+		return ctx_fail(ctx, "plugin: %s", dlerror());
+	}
+
+	const int* abi = dlsym(handle, "lisp_plugin_abi");
+	int (*init)(lisp_ctx*) = (int (*)(lisp_ctx*))dlsym(handle, "lisp_plugin_init");
+	if (abi == NULL || init == NULL) {
+		dlclose(handle);
+		return ctx_fail(ctx, "plugin: %s has no lisp_plugin_abi or lisp_plugin_init", path);
+	}
+	if (*abi != LISP_PLUGIN_ABI) {
+		dlclose(handle);
+		return ctx_fail(ctx, "plugin: %s is for abi %d, this is %d", path, *abi, LISP_PLUGIN_ABI);
+	}
+
+	// nothing of a plugin that fails is kept, its builtins would point
+	// into the unloaded object
+	int num_fns = ctx->builtins.num_fns;
+	ctx->error[0] = '\0';
+	if (init(ctx) != 0) {
+		ctx->builtins.num_fns = num_fns;
+		dlclose(handle);
+		if (ctx->error[0] == '\0') {
+			ctx_fail(ctx, "plugin: %s failed to load", path);
+		}
+		return -1;
+	}
+
+	ctx->plugins = realloc(ctx->plugins, sizeof(void*) * (ctx->num_plugins + 1));
+	ctx->plugins[ctx->num_plugins++] = handle;
+	return 0;
+}
+
+void lisp_set_budget(lisp_ctx* ctx, lisp_budget budget) {
+	ctx->budget = budget;
+}
+
+void lisp_set_trace(lisp_ctx* ctx, int max_events) {
+	if (ctx->trace != NULL) {
+		for (int i = 0; i < ctx->trace->num_names; i++) {
+			free(ctx->trace->names[i]);
+		}
+		free(ctx->trace->names);
+		free(ctx->trace->events);
+		free(ctx->trace);
+		ctx->trace = NULL;
+	}
+	if (max_events > 0) {
+		ctx->trace = calloc(1, sizeof(Trace));
+		ctx->trace->events = malloc(sizeof(TraceEvent) * max_events);
+		ctx->trace->cap = max_events;
+	}
+}
+
+void lisp_write_trace(lisp_ctx* ctx, FILE* f, lisp_trace_format format) {
+	if (ctx->trace == NULL) {
+		return;
+	}
+	if (format == LISP_TRACE_FOLDED) {
+		trace_write_folded(ctx->trace, f);
+	} else {
+		trace_write_chrome(ctx->trace, f);
+	}
+	ctx->trace->count = 0;
+}
+
+const char* lisp_error(lisp_ctx* ctx) {
+	return ctx->error;
+}
+
+// make this thread's panic() jump to on_error and allocate from heap
+#define rt_enter(ctx_, heap_, on_error_) \
+	do { \
+		(ctx_)->state = (RT_State){ \
+			.ctx = (ctx_), \
+			.builtins = (ctx_)->builtins.fns, \
+			.heap = (heap_), \
+			.on_error = (on_error_), \
+			.error = (ctx_)->error, \
+			.trace = (ctx_)->trace \
+		}; \
+		if ((ctx_)->trace != NULL) { \
+			(ctx_)->trace->depth = 0; \
+		} \
+		RT = &(ctx_)->state; \
+	} while(0)
+
+lisp_prog* lisp_compile(lisp_ctx* ctx, const char* src, size_t len) {
+
+	// volatile, it is freed after a longjmp
+	lisp_prog* volatile prog = calloc(1, sizeof(lisp_prog));
+	if (prog == NULL) {
+		ctx_fail(ctx, "runtime error: out of memory");
+		return NULL;
+	}
+
+	// tokens and ast nodes are only needed until parse() is done
+	Heap scratch = {0};
+	jmp_buf on_error;
+	rt_enter(ctx, &prog->heap, &on_error);
+
+	if (setjmp(on_error) != 0) {
+		heap_free_all(&scratch);
+		lisp_prog_free(prog);
+		RT = NULL;
+		return NULL;
+	}
+
+	// Tokens point into the source, so the program keeps its own copy
+	char* text = rt_alloc(len + 1);
+	if (text == NULL) {
+		panic("out of memory");
+	}
+	memcpy(text, src, len);
+	text[len] = '\0';
+
+	// the program ends at the first '\0', if there is one
+	RT->heap = &scratch;
+	len = strnlen(text, len);
+	ASTNode* forms = par_make_ast_forms(text, len);
+	uint64_t start;
+	if (forms == NULL) {
+		start = trace_begin();
+		TokenList tl = tokenize(text, len);
+		trace_end("tokenize", start);
+
+		start = trace_begin();
+		forms = make_ast_forms(tl);
+		trace_end("make_ast", start);
+	}
+
+	RT->heap = &prog->heap;
+	start = trace_begin();
+	prog->expr = parse_program(forms);
+	prog->num_params = RT->params_used;
+	trace_end("parse", start);
+
+	heap_free_all(&scratch);
+	ctx->compiled = true;
+	RT = NULL;
+	return prog;
+}
+
+void lisp_prog_free(lisp_prog* prog) {
+	heap_free_all(&prog->heap);
+	free(prog);
+}
+
+// what every evaluation starts with, once RT is set up
+void rt_eval_setup(lisp_ctx* ctx) {
+
+	// allocated once, outside of any Heap, so every eval reuses them
+	if (ctx->stack == NULL) {
+		ctx->stack = malloc(sizeof(Value) * RT_STACK_SIZE);
+		ctx->frames = malloc(sizeof(Frame) * RT_FRAMES_SIZE);
+		if (ctx->stack == NULL || ctx->frames == NULL) {
+			panic("out of memory");
+		}
+	}
+	RT->stack = ctx->stack;
+	RT->stack_cap = RT_STACK_SIZE;
+	RT->frames = ctx->frames;
+	RT->frames_cap = RT_FRAMES_SIZE;
+
+	// tick starts at 0, so the first step sets up the countdown
+	RT->max_steps = ctx->budget.max_steps;
+	RT->max_bytes = ctx->budget.max_bytes;
+	if (ctx->budget.max_ms > 0) {
+		RT->deadline = trace_now() + (uint64_t)ctx->budget.max_ms * 1000000;
+	}
+}
+
+int lisp_eval(lisp_ctx* ctx, lisp_prog* prog, Value* out) {
+	return lisp_eval_params(ctx, prog, NULL, 0, out);
+}
+
+int lisp_eval_params(lisp_ctx* ctx, lisp_prog* prog, const int* params, int num_params, Value* out) {
+
+	free_results(ctx);
+
+	jmp_buf on_error;
+	rt_enter(ctx, &ctx->eval_heap, &on_error);
+
+	if (setjmp(on_error) != 0) {
+		RT = NULL;
+		return -1;
+	}
+
+	rt_eval_setup(ctx);
+	RT->params = params;
+	RT->num_params = num_params;
+
+	uint64_t start = trace_begin();
+	*out = eval(prog->expr);
+	trace_end("eval", start);
+
+	RT = NULL;
+	return 0;
+}
+
+int lisp_eval_batch(lisp_ctx* ctx, lisp_prog* prog, const int* const* cols, int num_cols, int num_rows, int* out) {
+
+	free_results(ctx);
+
+	Heap scratch = {0};
+	jmp_buf on_error;
+	rt_enter(ctx, &ctx->eval_heap, &on_error);
+
+	if (setjmp(on_error) != 0) {
+		heap_free_all(&scratch);
+		RT = NULL;
+		return -1;
+	}
+
+	rt_eval_setup(ctx);
+	if (prog->num_params > num_cols) {
+		panic("the program uses $%d, but there are only %d columns",
+			prog->num_params - 1,
+			num_cols);
+	}
+
+	uint64_t start = trace_begin();
+	eval_batch(prog->expr, &scratch, cols, num_cols, num_rows, out);
+	trace_end("eval_batch", start);
+
+	heap_free_all(&scratch);
+	RT = NULL;
+	return 0;
+}
+
+/*	result cache: lisp_eval_source() keeps the results of whole programs.
+	they are looked up by their source first and, when that misses, by a
+	hash of their compiled Exprs, which leaves out variable names, so the
+	same program with other whitespace or other names is found as well.
+	only programs that depend on nothing but their source are cached (no
+	$n, no impure builtins) and only results made of ints and lists. the
+	least recently used entries go once there are more than max_entries
+	of them or they take more than max_bytes */
+
+typedef struct CacheEntry {
+	struct CacheEntry* prev; // most recently used first
+	struct CacheEntry* next;
+	struct CacheEntry* next_src; // chains of the two tables
+	struct CacheEntry* next_expr;
+
+	uint64_t src_hash;
+	uint64_t expr_hash;
+	char* src;
+	size_t src_len;
+	lisp_prog* prog; // to compare Exprs when their hashes match
+	Value value; // in memory owned by the entry
+	size_t bytes;
+} CacheEntry;
+
+typedef struct Cache {
+	CacheEntry** src_table;
+	CacheEntry** expr_table;
+	int num_buckets; // a power of 2
+
+	CacheEntry* head;
+	CacheEntry* tail;
+	int max_entries;
+	size_t max_bytes;
+
+	lisp_cache_stats stats;
+} Cache;
+
+uint64_t hash_mix(uint64_t h, uint64_t x) {
+	h = (h ^ x) * 0x9e3779b97f4a7c15;
+	return h ^ (h >> 29);
+}
+
+uint64_t hash_bytes(const char* s, size_t len) {
+	uint64_t h = 0xcbf29ce484222325;
+	for (size_t i = 0; i < len; i++) {
+		h = (h ^ (unsigned char)s[i]) * 0x100000001b3;
+	}
+	return hash_mix(h, len);
+}
+
+// everything about a node that its result depends on, names aside
+void expr_key(Expr* e, uint64_t key[2]) {
+	key[0] = e->type
+		| (uint64_t)e->captured << 8
+		| (uint64_t)e->fn << 16
+		| (uint64_t)e->num_kids << 32;
+	key[1] = 0;
+
+	switch (e->type) {
+		case E_INT: key[1] = (uint32_t)e->intlit; break;
+		case E_PARAM: key[1] = e->param; break;
+		case E_STRING: key[1] = hash_bytes(e->str.name, e->str.len); break;
+		case E_VALUE:
+			key[1] = e->value.type == V_INT
+				? (uint32_t)e->value.int_value
+				: (uintptr_t)e->value.func_value;
+			break;
+		case E_VAR: key[1] = (uint64_t)e->var.depth << 32 | (uint32_t)e->var.slot; break;
+		case E_DEFINE: key[1] = e->define.slot; break;
+		case E_SCOPE: key[1] = e->scope.num_slots; break;
+		case E_LAMBDA: key[1] = (uint64_t)e->lambda.num_params << 32 | (uint32_t)e->lambda.num_slots; break;
+	}
+}
+
+uint64_t expr_hash(Expr* e) {
+	uint64_t key[2];
+	expr_key(e, key);
+	uint64_t h = hash_mix(hash_mix(0, key[0]), key[1]);
+	for (uint32_t i = 0; i < e->num_kids; i++) {
+		h = hash_mix(h, expr_hash(expr_arg(e, i)));
+	}
+	return h;
+}
+
+bool expr_equal(Expr* a, Expr* b) {
+	uint64_t ka[2], kb[2];
+	expr_key(a, ka);
+	expr_key(b, kb);
+	if (ka[0] != kb[0] || ka[1] != kb[1]) {
+		return false;
+	}
+	// the key only has a hash of the string
+	if (a->type == E_STRING
+	&& (a->str.len != b->str.len || memcmp(a->str.name, b->str.name, a->str.len) != 0)) {
+		return false;
+	}
+	for (uint32_t i = 0; i < a->num_kids; i++) {
+		if (!expr_equal(expr_arg(a, i), expr_arg(b, i))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// whether e's result depends on nothing but e itself
+bool expr_pure(lisp_ctx* ctx, Expr* e) {
+	if (e->type == E_PARAM
+	|| (e->type == E_FUNCCALL && ctx->builtins.fns[e->fn].impure)
+	|| (e->type == E_VALUE && e->value.type == V_FUNC && e->value.func_value->impure)) {
+		return false;
+	}
+	for (uint32_t i = 0; i < e->num_kids; i++) {
+		if (!expr_pure(ctx, expr_arg(e, i))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// bytes a copy of v takes, or false if v has something that can't be
+// kept after the evaluation, ie. a function or a mapped file
+bool value_cache_size(Value v, size_t* bytes) {
+	if (v.type == V_INT) {
+		return true;
+	}
+	if (v.type != V_LIST || vl_mapped(v.list_value)) {
+		return false;
+	}
+	*bytes += sizeof(Value) * v.list_value.num_values;
+	for (int i = 0; i < v.list_value.num_values; i++) {
+		if (!value_cache_size(v.list_value.values[i], bytes)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// copy v into *mem, which has the room value_cache_size() asked for. the
+// lists have no VecHeader, they are only ever handed back to the caller
+Value value_cache_copy(Value v, char** mem) {
+	if (v.type != V_LIST || v.list_value.num_values == 0) {
+		if (v.type == V_LIST) {
+			v.list_value = (ValueList){0};
+		}
+		return v;
+	}
+
+	ValueList l = {.values = (Value*)*mem, .num_values = v.list_value.num_values};
+	*mem += sizeof(Value) * l.num_values;
+	for (int i = 0; i < l.num_values; i++) {
+		l.values[i] = value_cache_copy(v.list_value.values[i], mem);
+	}
+	return (Value){.type = V_LIST, .list_value = l};
+}
+
+#define cache_bucket(c, h) \
+	((h) & (uint64_t)((c)->num_buckets - 1))
+
+void cache_link_front(Cache* c, CacheEntry* e) {
+	e->prev = NULL;
+	e->next = c->head;
+	if (c->head != NULL) {
+		c->head->prev = e;
+	} else {
+		c->tail = e;
+	}
+	c->head = e;
+}
+
+void cache_unlink(Cache* c, CacheEntry* e) {
+	if (e->prev != NULL) {
+		e->prev->next = e->next;
+	} else {
+		c->head = e->next;
+	}
+	if (e->next != NULL) {
+		e->next->prev = e->prev;
+	} else {
+		c->tail = e->prev;
+	}
+}
+
+void cache_touch(Cache* c, CacheEntry* e) {
+	cache_unlink(c, e);
+	cache_link_front(c, e);
+}
+
+void cache_table_add(Cache* c, CacheEntry* e) {
+	CacheEntry** s = &c->src_table[cache_bucket(c, e->src_hash)];
+	e->next_src = *s;
+	*s = e;
+	CacheEntry** x = &c->expr_table[cache_bucket(c, e->expr_hash)];
+	e->next_expr = *x;
+	*x = e;
+}
+
+void cache_table_remove(Cache* c, CacheEntry* e) {
+	CacheEntry** s = &c->src_table[cache_bucket(c, e->src_hash)];
+	while (*s != e) {
+		s = &(*s)->next_src;
+	}
+	*s = e->next_src;
+	CacheEntry** x = &c->expr_table[cache_bucket(c, e->expr_hash)];
+	while (*x != e) {
+		x = &(*x)->next_expr;
+	}
+	*x = e->next_expr;
+}
+
+void cache_entry_free(CacheEntry* e) {
+	lisp_prog_free(e->prog);
+	free(e);
+}
+
+// twice the buckets, once there are more entries than buckets
+void cache_grow(Cache* c) {
+	free(c->src_table);
+	free(c->expr_table);
+	c->num_buckets *= 2;
+	c->src_table = calloc(c->num_buckets, sizeof(CacheEntry*));
+	c->expr_table = calloc(c->num_buckets, sizeof(CacheEntry*));
+	for (CacheEntry* e = c->head; e != NULL; e = e->next) {
+		cache_table_add(c, e);
+	}
+}
+
+CacheEntry* cache_find_src(Cache* c, uint64_t h, const char* src, size_t len) {
+	for (CacheEntry* e = c->src_table[cache_bucket(c, h)]; e != NULL; e = e->next_src) {
+		if (e->src_hash == h && e->src_len == len && !memcmp(e->src, src, len)) {
+			return e;
+		}
+	}
+	return NULL;
+}
+
+CacheEntry* cache_find_expr(Cache* c, uint64_t h, Expr* expr) {
+	for (CacheEntry* e = c->expr_table[cache_bucket(c, h)]; e != NULL; e = e->next_expr) {
+		if (e->expr_hash == h && expr_equal(e->prog->expr, expr)) {
+			return e;
+		}
+	}
+	return NULL;
+}
+
+// keep v as the result of prog, which the cache now owns. false if it
+// can't be kept, and then prog is still the caller's
+bool cache_add(Cache* c, uint64_t src_hash, const char* src, size_t len, lisp_prog* prog, uint64_t expr_hash, Value* v) {
+	size_t value_bytes = 0;
+	if (!value_cache_size(*v, &value_bytes)) {
+		return false;
+	}
+
+	size_t bytes = sizeof(CacheEntry) + value_bytes + len + sizeof(lisp_prog) + prog->heap.bytes;
+	if (c->max_bytes > 0 && bytes > c->max_bytes) {
+		return false;
+	}
 
-#define rt_varlist_new() \
-	((RT_VarList){0})
+	CacheEntry* e = malloc(sizeof(CacheEntry) + value_bytes + len);
+	if (e == NULL) {
+		return false;
+	}
+	char* mem = (char*)(e + 1);
+	*e = (CacheEntry){
+		.src_hash = src_hash,
+		.expr_hash = expr_hash,
+		.src_len = len,
+		.prog = prog,
+		.bytes = bytes
+	};
+	e->value = value_cache_copy(*v, &mem);
+	e->src = mem;
+	memcpy(e->src, src, len);
+
+	// make room first, so the new entry is never the one evicted
+	while (c->tail != NULL
+	&& ((c->max_entries > 0 && c->stats.entries + 1 > c->max_entries)
+	|| (c->max_bytes > 0 && c->stats.bytes + bytes > c->max_bytes))) {
+		CacheEntry* old = c->tail;
+		cache_unlink(c, old);
+		cache_table_remove(c, old);
+		c->stats.entries--;
+		c->stats.bytes -= old->bytes;
+		c->stats.evictions++;
+		cache_entry_free(old);
+	}
 
-#define rt_varlist_resize(l, n) \
-	do { \
-		(l).num_vars = (n); \
-		(l).vars = realloc((l).vars, sizeof(VarData) * (l).num_vars); \
-	} while(0)
+	cache_link_front(c, e);
+	c->stats.entries++;
+	c->stats.bytes += bytes;
+	if (c->stats.entries > c->num_buckets) {
+		cache_grow(c);
+	} else {
+		cache_table_add(c, e);
+	}
 
-#define rt_varlist_append(l, ...) \
-	do { \
-		rt_varlist_resize(l, (l).num_vars + 1); \
-		(l).vars[(l).num_vars - 1] = (VarData)__VA_ARGS__; \
-	} while(0)
+	*v = e->value;
+	return true;
+}
 
-#define rt_varlist_swap(l, i, j) \
-	do { \
-		VarData temp = (l).vars[(i)]; \
-		(l).vars[(i)] = (l).vars[(j)]; \
-		(l).vars[(j)] = temp; \
-	} while(0)
+void lisp_set_cache(lisp_ctx* ctx, int max_entries, size_t max_bytes) {
+	Cache* c = ctx->cache;
+	if (c != NULL) {
+		while (c->head != NULL) {
+			CacheEntry* e = c->head;
+			c->head = e->next;
+			cache_entry_free(e);
+		}
+		free(c->src_table);
+		free(c->expr_table);
+		free(c);
+		ctx->cache = NULL;
+	}
 
-#define rt_varlist_remove(l, index) \
-	do { \
-		rt_fnlist_swap(l, index, (l).num_vars - 1); \
-		rt_fnlist_resize(l, (l).num_vars - 1); \
-	} while(0)
+	if (max_entries > 0 || max_bytes > 0) {
+		c = calloc(1, sizeof(Cache));
+		c->max_entries = max_entries;
+		c->max_bytes = max_bytes;
+		c->num_buckets = 64;
+		c->src_table = calloc(c->num_buckets, sizeof(CacheEntry*));
+		c->expr_table = calloc(c->num_buckets, sizeof(CacheEntry*));
+		ctx->cache = c;
+	}
+}
 
-RT_VarList RT_CONSTANT_VARS = {0};
+lisp_cache_stats lisp_get_cache_stats(lisp_ctx* ctx) {
+	return ctx->cache != NULL ? ctx->cache->stats : (lisp_cache_stats){0};
+}
 
-// a name that starts with '#'
-Value eval_constant(Expr* e) {
-	for (int i = 0; i < RT_CONSTANT_VARS.num_vars; i++) {
-		VarData* vd = &RT_CONSTANT_VARS.vars[i];
-		if (!strncmp(
-			vd->name,
-			e->ident.name,
-			e->ident.len))
-		{
-			// names match
-			return vd->value;
+int lisp_eval_source(lisp_ctx* ctx, const char* src, size_t len, Value* out) {
+	Cache* c = ctx->cache;
+
+	if (ctx->last_prog != NULL) {
+		lisp_prog_free(ctx->last_prog);
+		ctx->last_prog = NULL;
+	}
+
+	uint64_t src_hash = 0;
+	if (c != NULL) {
+		src_hash = hash_bytes(src, len);
+		CacheEntry* e = cache_find_src(c, src_hash, src, len);
+		if (e != NULL) {
+			cache_touch(c, e);
+			c->stats.source_hits++;
+			*out = e->value;
+			return 0;
+		}
+	}
+
+	lisp_prog* prog = lisp_compile(ctx, src, len);
+	if (prog == NULL) {
+		return -1;
+	}
+
+	bool pure = c != NULL && expr_pure(ctx, prog->expr);
+	uint64_t h = 0;
+	if (pure) {
+		h = expr_hash(prog->expr);
+		CacheEntry* e = cache_find_expr(c, h, prog->expr);
+		if (e != NULL) {
+			cache_touch(c, e);
+			c->stats.expr_hits++;
+			*out = e->value;
+			lisp_prog_free(prog);
+			return 0;
 		}
+		c->stats.misses++;
+	}
+
+	int status = lisp_eval(ctx, prog, out);
+
+	// a closure in the result still needs its Exprs
+	if (status != 0 || !pure || !cache_add(c, src_hash, src, len, prog, h, out)) {
+		ctx->last_prog = prog;
 	}
-	panic("unknown constant %.*s", e->ident.len, e->ident.name);
+	return status;
 }
 
-Value eval(Expr* e) {
-	if (e->type == E_INT) {
-		return (Value){.type = V_INT, .int_value = e->intlit};
+/*	ahead of time compilation: lisp_emit_c() writes a program out as a C
+	file that needs nothing from lisp.c. it handles the part of the
+	language that is only ints: int literals, $n, #constants, if, let,
+	define, defuns at the top level and calls to them, and the int
+	builtins, which become C operators or small helpers doing exactly what
+	the builtin does. every scope's slots are C locals and every defun a C
+	function. top level variables a defun reads become globals. lambdas as
+	values, closures over anything but the top level and lists are refused
+	with an error, as are other builtins. C locals can't be unset, so a
+	variable that might be read before it is defined (which the
+	interpreter fails on when it happens) is refused too */
+
+typedef struct {
+	E_Func* fn;
+	const char* pre; // the C for (f a b) is pre a mid b post
+	const char* mid; // NULL for one argument
+	const char* post;
+} AotBuiltin;
+
+static const AotBuiltin aot_builtins[] = {
+	{e_func_add, "(", " + ", ")"},
+	{e_func_sub, "(", " - ", ")"},
+	{e_func_mul, "(", " * ", ")"},
+	{e_func_mod, "aot_mod(", ", ", ")"},
+	{e_func_eq, "(", " == ", ")"},
+	{e_func_neq, "(", " != ", ")"},
+	{e_func_lt, "(", " < ", ")"},
+	{e_func_gt, "(", " > ", ")"},
+	{e_func_le, "(", " <= ", ")"},
+	{e_func_ge, "(", " >= ", ")"},
+	{e_func_bool, "(!!", NULL, ")"},
+	{e_func_sq, "aot_sq(", NULL, ")"},
+	{e_func_odd, "(", NULL, " % 2 != 0)"},
+	{e_func_even, "(", NULL, " % 2 == 0)"},
+	{e_func_fib, "(int)aot_fib(", NULL, ")"},
+};
+
+// the runtime frames around the code being emitted
+typedef struct AotScope {
+	Expr* e; // E_SCOPE or E_LAMBDA
+	int id; // variables are v<id>_<slot>, the top level is 0
+	struct AotScope* up;
+
+	// slots that are defined on every path to the code being emitted
+	bool* defined;
+	int num_slots;
+} AotScope;
+
+typedef struct {
+	FILE* out;
+	AotScope* scope;
+	Expr* top;
+	int next_id;
+	int next_tmp;
+	int indent; // of statements, in tabs
+
+	AotScope* scope_top;
+	Expr** funcs; // for each top level slot, the lambda bound to it or NULL
+	bool* globals; // top level slots read by a defun
+	bool params_global; // a defun reads $n
+
+	// the parts written before the file, closed and freed on errors too
+	FILE* mem; // out while writing one of them
+	char* funcs_text;
+	char* run_text;
+	size_t text_len;
+} Aot;
+
+void aot_expr(Aot* a, Expr* e);
+
+void aot_push_scope(Aot* a, AotScope* sc, Expr* e, int num_slots) {
+	*sc = (AotScope){
+		.e = e,
+		.id = a->next_id++,
+		.up = a->scope,
+		.defined = rt_calloc(sizeof(bool) * (num_slots + 1)),
+		.num_slots = num_slots
+	};
+	a->scope = sc;
+}
+
+void aot_pop_scope(Aot* a) {
+	rt_free(a->scope->defined);
+	a->scope = a->scope->up;
+}
+
+// output into *text, until aot_close()
+void aot_open(Aot* a, char** text) {
+	a->mem = open_memstream(text, &a->text_len);
+	if (a->mem == NULL) {
+		panic("out of memory");
+	}
+	a->out = a->mem;
+}
+
+void aot_close(Aot* a) {
+	fclose(a->mem);
+	a->mem = NULL;
+	a->out = NULL;
+}
+
+void aot_free(Aot* a) {
+	if (a->mem != NULL) {
+		aot_close(a);
 	}
+	free(a->funcs_text);
+	free(a->run_text);
+	a->funcs_text = NULL;
+	a->run_text = NULL;
+}
 
-	if (e->type == E_IDENT) {
-		if (e->ident.len == 0) {
-			panic("somehow ident len is 0, fix this now");
+bool aot_in_func(Aot* a) {
+	for (AotScope* sc = a->scope; sc != NULL; sc = sc->up) {
+		if (sc->e->type == E_LAMBDA) {
+			return true;
 		}
+	}
+	return false;
+}
+
+void aot_check_call(Aot* a, int slot, bool* seen);
 
-		if (e->ident.name[0] == '#') {
-			// constant
-			return eval_constant(e);
+// the top level variables e reads, from level scopes below the top level
+void aot_check_reads(Aot* a, Expr* e, int level, bool* seen) {
+	bool* defined = a->scope_top->defined;
+
+	if (e->type == E_VAR && e->var.depth == level) {
+		if (!defined[e->var.slot]) {
+			panic("%.*s: may be used before it is defined, which C can't check",
+				e->var.name.len, e->var.name.name);
+		}
+		return;
+	}
+	uint32_t first = 0;
+	if (e->type == E_CALL) {
+		Expr* f = expr_arg(e, 0);
+		if (f->type == E_VAR && f->var.depth == level && a->funcs[f->var.slot] != NULL) {
+			aot_check_call(a, f->var.slot, seen);
+			first = 1;
 		}
-		
-		panic("ident %.*s has no value yet", e->ident.len, e->ident.name);
 	}
+	for (uint32_t i = first; i < e->num_kids; i++) {
+		aot_check_reads(a, expr_arg(e, i), e->type == E_SCOPE ? level + 1 : level, seen);
+	}
+}
 
-	if (e->type == E_FUNCCALL) {
-		assert_funccall_arg_count_correct(e);
-		return e->funccall.func.actual_function(e);
+// a defun runs with the top level as it is where it is called from, so
+// it and every defun it can call, and the top level variables they read,
+// have to be defined there
+void aot_check_call(Aot* a, int slot, bool* seen) {
+	if (seen[slot]) {
+		return;
+	}
+	seen[slot] = true;
+	if (!a->scope_top->defined[slot]) {
+		panic("%s: may be called before it is defined, which C can't check",
+			a->funcs[slot]->lambda.name);
+	}
+	Expr* lambda = a->funcs[slot];
+	for (uint32_t i = 0; i < lambda->num_kids; i++) {
+		aot_check_reads(a, expr_arg(lambda, i), 1, seen);
 	}
 }
 
-/*
-	TODO
-	- make sure parens are balanced and token list is well formed
-	- ast edge cases?
-	- "or" and "and" functions for list of bools
-	- remaining math+comparison functions
-	- specific types for bool and float
-	- printing types ("list of bool") or type representation
-		- maybe (type mylist (list bool))
-	- string types and string literals
-	- runtime and variables
-	- reading from a file/command line interface and help messages
-	- repl mode
-	- better error messages
+// C names are made from the slot, with the name for reading the output
+void aot_func_name(Aot* a, int slot) {
+	fprintf(a->out, "f%d_", slot);
+	for (char* c = a->funcs[slot]->lambda.name; *c != '\0'; c++) {
+		putc(isalnum((unsigned char)*c) ? *c : '_', a->out);
+	}
+}
 
-	
+// the top level slot of a function e calls, or -1 if it isn't a defun
+int aot_callee(Aot* a, Expr* e) {
+	Expr* f = expr_arg(e, 0);
+	if (f->type != E_VAR) {
+		return -1;
+	}
 
-	language currently supports:
+	AotScope* sc = a->scope;
+	for (int d = f->var.depth; d > 0; d--) {
+		sc = sc->up;
+	}
+	if (sc->id != 0 || a->funcs[f->var.slot] == NULL) {
+		return -1;
+	}
+	return f->var.slot;
+}
 
-	- builtin types:
-		- ints, or just integer literals that fit into standard C int type
-		- lists of int literals
-		- TODO boolean constants #true and #false
+void aot_indent(Aot* a) {
+	for (int i = 0; i < a->indent; i++) {
+		putc('\t', a->out);
+	}
+}
 
-	- constants which always start with a #, but it's not a reserved character
+bool aot_has_define(Expr* e) {
+	if (e->type == E_DEFINE) {
+		return true;
+	}
+	for (uint32_t i = 0; i < e->num_kids; i++) {
+		if (aot_has_define(expr_arg(e, i))) {
+			return true;
+		}
+	}
+	return false;
+}
 
-	- ability to do function calls with prefix notation similar to lisp
-		(+ 5 6) = 11
+// the args of e from first on, separated by sep. C leaves the order of
+// evaluating operands open, so when one of them defines a variable they
+// are put in temporaries t<n>_<i> first, in order, like eval() does
+int aot_sequence_args(Aot* a, Expr* e, int first) {
+	bool defines = false;
+	for (uint32_t i = first; i < e->num_kids; i++) {
+		defines |= aot_has_define(expr_arg(e, i));
+	}
+	if (!defines || e->num_kids - first < 2) {
+		return -1;
+	}
 
-	- builtin functions:
+	int tmp = a->next_tmp++;
+	fprintf(a->out, "({ ");
+	for (uint32_t i = first; i < e->num_kids; i++) {
+		fprintf(a->out, "int t%d_%d = ", tmp, i);
+		aot_expr(a, expr_arg(e, i));
+		fprintf(a->out, "; ");
+	}
+	return tmp;
+}
 
-		- arithmetic operators, all are (int, int) -> int
-			(+ x y)
-			(- x y)
-			(* x y)
-			(% x y)
+void aot_arg(Aot* a, Expr* e, int i, int tmp) {
+	if (tmp >= 0) {
+		fprintf(a->out, "t%d_%d", tmp, i);
+	} else {
+		aot_expr(a, expr_arg(e, i));
+	}
+}
 
-		- comparison operators, all are (int, int) -> int
-			(= x y)
-			(!= x y)
-			(< x y)
-			(<= x y)
-			(> x y)
-			(>= x y)
+// the expressions of a body as statements, except the last one
+void aot_body(Aot* a, Expr* body) {
+	for (uint32_t i = 0; i + 1 < body->num_kids; i++) {
+		Expr* k = expr_arg(body, i);
 
-		- type conversion
-			(bool x) - convert a number to 0 or 1 (equivalent to `!!x` in C)
+		// defuns at the top level are C functions already
+		if (k->type == E_DEFINE && a->scope->id == 0 && a->funcs[k->define.slot] != NULL) {
+			a->scope->defined[k->define.slot] = true;
+			continue;
+		}
+		aot_indent(a);
+		if (k->type != E_DEFINE) {
+			fprintf(a->out, "(void)");
+		}
+		aot_expr(a, k);
+		fprintf(a->out, ";\n");
+	}
+}
 
-		- list operations
-			(list ...) - construct a list of ints
-			(len l) - get the length of a list
-			(sum l) - sum up a list of ints
-			(range start stop) - construct a list of ints in range [start, stop)
+// declare slots first.. of the innermost scope
+void aot_locals(Aot* a, int first, int num_slots) {
+	for (int i = first; i < num_slots; i++) {
+		if (a->scope->id != 0 || (!a->globals[i] && a->funcs[i] == NULL)) {
+			aot_indent(a);
+			fprintf(a->out, "int v%d_%d = 0;\n", a->scope->id, i);
+		}
+	}
+}
 
-		- logic
-			(if cond then else)
+void aot_expr(Aot* a, Expr* e) {
+	FILE* out = a->out;
 
-		- other
-			(fib n) - compute nth fibonacci number
+	if (e->type == E_INT || (e->type == E_VALUE && e->value.type == V_INT)) {
+		int n = e->type == E_INT ? e->intlit : e->value.int_value;
+		if (n == INT_MIN) {
+			fprintf(out, "(-%d - 1)", INT_MAX);
+		} else {
+			fprintf(out, n < 0 ? "(%d)" : "%d", n);
+		}
 
-*/
+	} else if (e->type == E_PARAM) {
+		fprintf(out, "params[%d]", e->param);
+		for (AotScope* sc = a->scope; sc != NULL; sc = sc->up) {
+			a->params_global |= sc->e->type == E_LAMBDA;
+		}
+
+	} else if (e->type == E_VAR) {
+		AotScope* sc = a->scope;
+		bool in_lambda = false;
+		for (int d = e->var.depth; d > 0; d--) {
+			in_lambda |= sc->e->type == E_LAMBDA;
+			sc = sc->up;
+		}
+		if (sc->id == 0 && a->funcs[e->var.slot] != NULL) {
+			panic("%.*s: a function can only be called when compiled to C",
+				e->var.name.len, e->var.name.name);
+		}
+		if (in_lambda && sc->id != 0) {
+			panic("%.*s: a defun compiled to C can only read its own and top level variables",
+				e->var.name.len, e->var.name.name);
+		}
+		if (in_lambda) {
+			// checked where the defun is called, see aot_check_call()
+			a->globals[e->var.slot] = true;
+		} else if (!sc->defined[e->var.slot]) {
+			panic("%.*s: may be used before it is defined, which C can't check",
+				e->var.name.len, e->var.name.name);
+		}
+		fprintf(out, "v%d_%d", sc->id, e->var.slot);
 
-void rt_init();
+	} else if (e->type == E_DEFINE) {
+		if (a->scope->id == 0 && a->funcs[e->define.slot] != NULL) {
+			panic("%.*s: a function can't be redefined when compiled to C",
+				e->define.name.len, e->define.name.name);
+		}
+		fprintf(out, "(v%d_%d = ", a->scope->id, e->define.slot);
+		aot_expr(a, expr_arg(e, 0));
+		fprintf(out, ")");
+		a->scope->defined[e->define.slot] = true;
+
+	} else if (e->type == E_IF) {
+		// what either branch defines is only defined if both do
+		bool* defined = a->scope->defined;
+		size_t size = sizeof(bool) * a->scope->num_slots;
+		bool* after_cond = rt_alloc(size + 1);
+
+		fprintf(out, "(");
+		aot_expr(a, expr_arg(e, 0));
+		memcpy(after_cond, defined, size);
+		fprintf(out, " ? ");
+		aot_expr(a, expr_arg(e, 1));
+		fprintf(out, " : ");
+		for (int i = 0; i < a->scope->num_slots; i++) {
+			bool in_then = defined[i];
+			defined[i] = after_cond[i];
+			after_cond[i] = in_then;
+		}
+		aot_expr(a, expr_arg(e, 2));
+		fprintf(out, ")");
+		for (int i = 0; i < a->scope->num_slots; i++) {
+			defined[i] &= after_cond[i];
+		}
+		rt_free(after_cond);
+
+	} else if (e->type == E_SCOPE) {
+		AotScope sc;
+		aot_push_scope(a, &sc, e, e->scope.num_slots);
+		fprintf(out, "({\n");
+		a->indent++;
+		aot_locals(a, 0, e->scope.num_slots);
+		aot_body(a, e);
+		aot_indent(a);
+		aot_expr(a, expr_arg(e, e->num_kids - 1));
+		fprintf(out, ";\n");
+		a->indent--;
+		aot_indent(a);
+		fprintf(out, "})");
+		aot_pop_scope(a);
 
-int main() {
+	} else if (e->type == E_FUNCCALL) {
+		E_FuncData* fd = &RT->builtins[e->fn];
+		const AotBuiltin* b = NULL;
+		for (size_t i = 0; i < sizeof(aot_builtins) / sizeof(aot_builtins[0]); i++) {
+			if (aot_builtins[i].fn == fd->actual_function) {
+				b = &aot_builtins[i];
+			}
+		}
+		if (b == NULL) {
+			panic("%s: can't be compiled to C, only int builtins can", fd->name);
+		}
 
-	rt_init();
+		int tmp = aot_sequence_args(a, e, 0);
+		fprintf(out, "%s", b->pre);
+		aot_arg(a, e, 0, tmp);
+		if (b->mid != NULL) {
+			fprintf(out, "%s", b->mid);
+			aot_arg(a, e, 1, tmp);
+		}
+		fprintf(out, "%s", b->post);
+		if (tmp >= 0) {
+			fprintf(out, "; })");
+		}
 
-	char* line = "(if #false 5 11)";	
-	TokenList tl = tokenize(line);
-	ASTNode* ast = make_ast(tl);
-	Expr* e = parse(ast);
-	Value result = eval(e);
+	} else if (e->type == E_CALL) {
+		int slot = aot_callee(a, e);
+		if (slot < 0) {
+			panic("only defuns at the top level can be called when compiled to C");
+		}
+		Expr* lambda = a->funcs[slot];
+		if (lambda->lambda.num_params != (int)e->num_kids - 1) {
+			panic("%s: expected %d arguments, got %d",
+				lambda->lambda.name,
+				lambda->lambda.num_params,
+				e->num_kids - 1);
+		}
 
-	// printf("%d\n", result.list_value.num_values);
-	printf("%d\n", result.int_value);
-	
+		int tmp = aot_sequence_args(a, e, 1);
+		aot_func_name(a, slot);
+		fprintf(out, "(");
+		for (uint32_t i = 1; i < e->num_kids; i++) {
+			fputs(i > 1 ? ", " : "", out);
+			aot_arg(a, e, i, tmp);
+		}
+		fprintf(out, ")");
+		if (tmp >= 0) {
+			fprintf(out, "; })");
+		}
+
+		// between defuns this is checked where the outermost one is called
+		if (!aot_in_func(a)) {
+			bool* seen = rt_calloc(sizeof(bool) * (a->scope_top->num_slots + 1));
+			aot_check_call(a, slot, seen);
+			rt_free(seen);
+		}
+
+	} else if (e->type == E_LAMBDA) {
+		panic("%s: only defuns at the top level can be compiled to C", e->lambda.name);
+
+	} else {
+		panic("can't compile a %s value to C",
+			e->type == E_VALUE ? stringify_value_type(e->value.type) : "non-int");
+	}
+}
+
+// static int f<slot>_<name>(int v<id>_0, ...) { ... }
+void aot_func(Aot* a, int slot) {
+	Expr* lambda = a->funcs[slot];
+	AotScope sc;
+	aot_push_scope(a, &sc, lambda, lambda->lambda.num_slots);
+	for (int i = 0; i < lambda->lambda.num_params; i++) {
+		sc.defined[i] = true;
+	}
+
+	fprintf(a->out, "static int ");
+	aot_func_name(a, slot);
+	fprintf(a->out, "(");
+	for (int i = 0; i < lambda->lambda.num_params; i++) {
+		fprintf(a->out, "%sint v%d_%d", i > 0 ? ", " : "", sc.id, i);
+	}
+	fprintf(a->out, "%s) {\n", lambda->lambda.num_params == 0 ? "void" : "");
+
+	a->indent = 1;
+	aot_locals(a, lambda->lambda.num_params, lambda->lambda.num_slots);
+	aot_body(a, lambda);
+	aot_indent(a);
+	fprintf(a->out, "return ");
+	aot_expr(a, expr_arg(lambda, lambda->num_kids - 1));
+	fprintf(a->out, ";\n}\n\n");
+	aot_pop_scope(a);
+}
+
+// the file: helpers, globals, the defuns, then the top level as
+// <name>_run() and the entry points around it
+void aot_program(Aot* a, const char* name, int num_params, FILE* f) {
+	Expr* top = a->top;
+	int num_slots = top->scope.num_slots;
+	a->funcs = rt_calloc(sizeof(Expr*) * (num_slots + 1));
+	a->globals = rt_calloc(sizeof(bool) * (num_slots + 1));
+
+	Expr* last = expr_arg(top, top->num_kids - 1);
+	for (uint32_t i = 0; i < top->num_kids; i++) {
+		Expr* k = expr_arg(top, i);
+		if (k->type != E_DEFINE || expr_arg(k, 0)->type != E_LAMBDA) {
+			continue;
+		}
+		if (a->funcs[k->define.slot] != NULL) {
+			panic("%.*s: a function can't be redefined when compiled to C",
+				k->define.name.len, k->define.name.name);
+		}
+		if (k == last) {
+			panic("%.*s: the result has to be an int to compile to C",
+				k->define.name.len, k->define.name.name);
+		}
+		a->funcs[k->define.slot] = expr_arg(k, 0);
+	}
+
+	// the defuns first, which finds the globals and whether they read $n
+	aot_open(a, &a->funcs_text);
+	AotScope sc;
+	aot_push_scope(a, &sc, top, num_slots);
+	a->scope_top = &sc;
+	for (int i = 0; i < num_slots; i++) {
+		if (a->funcs[i] != NULL) {
+			aot_func(a, i);
+		}
+	}
+	aot_close(a);
+
+	aot_open(a, &a->run_text);
+	a->indent = 1;
+	aot_locals(a, 0, num_slots);
+	aot_body(a, top);
+	fprintf(a->out, "\treturn ");
+	aot_expr(a, last);
+	fprintf(a->out, ";\n");
+	aot_close(a);
+	aot_pop_scope(a);
+
+	a->out = f;
+	fprintf(f, "// generated by lisp_emit_c(). build with -O3 -fwrapv: overflow wraps\n"
+		"// around like it does in the interpreter\n\n"
+		"#include <stddef.h>\n\n"
+		"#ifndef LISP_AOT_HELPERS\n"
+		"#define LISP_AOT_HELPERS\n"
+		"// set by a division by zero, which fails the evaluation like in the\n"
+		"// interpreter\n"
+		"static __thread int aot_error;\n"
+		"static inline int aot_sq(int n) { return n * n; }\n"
+		"static inline int aot_mod(int a, int b) {\n"
+		"\tif (b == 0) {\n"
+		"\t\taot_error = 1;\n"
+		"\t\treturn 0;\n"
+		"\t}\n"
+		"\treturn b == -1 ? 0 : a %% b;\n"
+		"}\n"
+		"static inline size_t aot_fib(int n) { return n < 2 ? 1 : aot_fib(n - 1) + aot_fib(n - 2); }\n"
+		"// batch loops are vectorized at -O3, also for AVX2 if the cpu has it\n"
+		"#if defined(__x86_64__) && defined(__GNUC__)\n"
+		"#define AOT_BATCH __attribute__((target_clones(\"avx2\", \"default\")))\n"
+		"#else\n"
+		"#define AOT_BATCH\n"
+		"#endif\n"
+		"#endif\n\n");
+
+	if (a->params_global) {
+		fprintf(f, "static __thread const int* params;\n");
+	}
+	for (int i = 0; i < num_slots; i++) {
+		if (a->globals[i]) {
+			fprintf(f, "static __thread int v0_%d;\n", i);
+		}
+	}
+	for (int i = 0; i < num_slots; i++) {
+		if (a->funcs[i] != NULL) {
+			fprintf(f, "static int ");
+			aot_func_name(a, i);
+			fprintf(f, "(");
+			for (int j = 0; j < a->funcs[i]->lambda.num_params; j++) {
+				fprintf(f, "%sint", j > 0 ? ", " : "");
+			}
+			fprintf(f, "%s);\n", a->funcs[i]->lambda.num_params == 0 ? "void" : "");
+		}
+	}
+	fprintf(f, "\n%s", a->funcs_text);
+
+	fprintf(f, "static inline int %s_run(const int* %s) {\n", name,
+		a->params_global ? "inputs" : "params");
+	if (a->params_global) {
+		fprintf(f, "\tparams = inputs;\n");
+	}
+	fprintf(f, "%s}\n\n", a->run_text);
+	aot_free(a);
+
+	// the same entry points as lisp_eval_params() and lisp_eval_batch()
+	int size = num_params > 0 ? num_params : 1;
+	fprintf(f, "const int %s_num_params = %d;\n\n", name, num_params);
+	fprintf(f, "int %s_eval(const int* params, int num_params, int* out) {\n"
+		"\tif (num_params < %d) {\n"
+		"\t\treturn -1;\n"
+		"\t}\n"
+		"\taot_error = 0;\n"
+		"\t*out = %s_run(params);\n"
+		"\treturn aot_error ? -1 : 0;\n"
+		"}\n\n", name, num_params, name);
+	fprintf(f, "AOT_BATCH int %s_batch(const int* const* cols, int num_rows, int* out) {\n"
+		"\taot_error = 0;\n"
+		"\tfor (int r = 0; r < num_rows; r++) {\n"
+		"\t\tint params[%d];\n"
+		"\t\tfor (int i = 0; i < %d; i++) {\n"
+		"\t\t\tparams[i] = cols[i][r];\n"
+		"\t\t}\n"
+		"\t\tout[r] = %s_run(params);\n"
+		"\t}\n"
+		"\treturn aot_error ? -1 : 0;\n"
+		"}\n\n", name, size, num_params, name);
+
+	// ./program $0 $1 ... prints the result
+	fprintf(f, "#ifdef LISP_AOT_MAIN\n"
+		"#include <stdio.h>\n"
+		"#include <stdlib.h>\n\n"
+		"int main(int argc, char** argv) {\n"
+		"\tint params[%d];\n"
+		"\tif (argc - 1 < %d) {\n"
+		"\t\tfprintf(stderr, \"usage: %%s $0 .. $%d\\n\", argv[0]);\n"
+		"\t\treturn 1;\n"
+		"\t}\n"
+		"\tfor (int i = 0; i < %d; i++) {\n"
+		"\t\tparams[i] = atoi(argv[i + 1]);\n"
+		"\t}\n"
+		"\tint out;\n"
+		"\tif (%s_eval(params, %d, &out) != 0) {\n"
+		"\t\tfprintf(stderr, \"runtime error: %%%%: division by zero\\n\");\n"
+		"\t\treturn 1;\n"
+		"\t}\n"
+		"\tprintf(\"%%d\\n\", out);\n"
+		"\treturn 0;\n"
+		"}\n"
+		"#endif\n", size, num_params, num_params - 1, num_params, name, num_params);
+}
+
+int lisp_emit_c(lisp_ctx* ctx, lisp_prog* prog, const char* name, FILE* f) {
+
+	Heap scratch = {0};
+	Aot a = {.top = prog->expr};
+	jmp_buf on_error;
+	rt_enter(ctx, &scratch, &on_error);
+
+	if (setjmp(on_error) != 0) {
+		aot_free(&a);
+		heap_free_all(&scratch);
+		RT = NULL;
+		return -1;
+	}
+
+	if (!isalpha((unsigned char)name[0]) && name[0] != '_') {
+		panic("%s is not a C identifier", name);
+	}
+	for (const char* c = name; *c != '\0'; c++) {
+		if (!isalnum((unsigned char)*c) && *c != '_') {
+			panic("%s is not a C identifier", name);
+		}
+	}
+
+	aot_program(&a, name, prog->num_params, f);
+
+	heap_free_all(&scratch);
+	RT = NULL;
 	return 0;
 }
 
-#define rt_add_constant(name_cstrlit, ...) \
-	rt_varlist_append(RT_CONSTANT_VARS, (VarData){ \
-		.name=(name_cstrlit), \
-		.value=(__VA_ARGS__) \
-	})
+Value lisp_list_get(ValueList l, int i) {
+	if (vl_mapped(l)) {
+		return (Value){.type = V_INT, .int_value = (int)vl_mapped_raw(l, i)};
+	}
+	return l.values[i];
+}
 
-// declare a runtime function (without having to specify name len separately)
-// the ... is the list of return types so you can pass like {V_INT, V_LIST, V_INT, ...}
-// for varargs all of the varargs will be evaluated as the last type in the list
-// and num_args should be the number of REQUIRED (aka non-vararg) arguments, 
-// which can be 0
-#define rt_add_func(name_cstrlit, actual_func_ptr, \
-func_arg_count, func_ret_type, ...) \
-	rt_fnlist_append(RT_BUILTIN_FUNCTIONS, (E_FuncData){ \
-		.name = (name_cstrlit), \
-		.name_len = strlen(name_cstrlit), \
-		.num_args = (func_arg_count == RTFN_VARARGS \
-			? RTFN_VARARGS \
-			: (int) (sizeof((ValueType[]) __VA_ARGS__) / sizeof(ValueType))), \
-		.arg_types = ((ValueType[]) __VA_ARGS__), \
-		.return_type = func_ret_type, \
-		.actual_function = (actual_func_ptr) \
-	})
+bool lisp_map_get(ValueMap m, int key, int* out) {
+	int i = map_find(m, key);
+	if (i < 0) {
+		return false;
+	}
+	*out = map_entry(m.table, i)->value;
+	return true;
+}
+
+void lisp_print_value(FILE* f, Value v) {
+	if (v.type == V_INT) {
+		fprintf(f, "%d", v.int_value);
+	} else if (v.type == V_LIST && vl_mapped(v.list_value)) {
+		// as in the file, even the int64s that don't fit in an int
+		putc('(', f);
+		for (int i = 0; i < v.list_value.num_values; i++) {
+			fprintf(f, i == 0 ? "%lld" : " %lld", (long long)vl_mapped_raw(v.list_value, i));
+		}
+		putc(')', f);
+	} else if (v.type == V_LIST) {
+		putc('(', f);
+		for (int i = 0; i < v.list_value.num_values; i++) {
+			if (i != 0) {
+				putc(' ', f);
+			}
+			lisp_print_value(f, v.list_value.values[i]);
+		}
+		putc(')', f);
+	} else if (v.type == V_MAP) {
+		// {k v k v ...}, in the order the keys were last put
+		ValueMap m = v.map_value;
+		putc('{', f);
+		for (int i = 0, n = 0; i < m.version; i++) {
+			MapEntry* e = map_entry(m.table, i);
+			if (map_find(m, e->key) == i) {
+				fprintf(f, n++ == 0 ? "%d %d" : " %d %d", e->key, e->value);
+			}
+		}
+		putc('}', f);
+	} else if (v.type == V_FUNC) {
+		fprintf(f, "<function %s>", v.func_value->name);
+	} else {
+		putc('?', f);
+	}
+}
+
+int lisp_format_value(char* buf, size_t size, Value v) {
+	// keep appending after a truncation, only to count the full length
+	#define fmt_append(...) \
+		do { \
+			size_t used = (size_t)len < size ? (size_t)len : size; \
+			len += snprintf(buf + used, size - used, __VA_ARGS__); \
+		} while(0)
+
+	int len = 0;
+
+	if (v.type == V_INT) {
+		fmt_append("%d", v.int_value);
+	} else if (v.type == V_LIST && vl_mapped(v.list_value)) {
+		fmt_append("(");
+		for (int i = 0; i < v.list_value.num_values; i++) {
+			fmt_append(i == 0 ? "%lld" : " %lld", (long long)vl_mapped_raw(v.list_value, i));
+		}
+		fmt_append(")");
+	} else if (v.type == V_LIST) {
+		fmt_append("(");
+		for (int i = 0; i < v.list_value.num_values; i++) {
+			fmt_append(i == 0 ? "%d" : " %d", v.list_value.values[i].int_value);
+		}
+		fmt_append(")");
+	} else if (v.type == V_MAP) {
+		ValueMap m = v.map_value;
+		fmt_append("{");
+		for (int i = 0, n = 0; i < m.version; i++) {
+			MapEntry* e = map_entry(m.table, i);
+			if (map_find(m, e->key) == i) {
+				fmt_append(n++ == 0 ? "%d %d" : " %d %d", e->key, e->value);
+			}
+		}
+		fmt_append("}");
+	} else if (v.type == V_FUNC) {
+		fmt_append("<function %s>", v.func_value->name);
+	} else {
+		fmt_append("?");
+	}
 
-void rt_init() {
-
-	RT_CONSTANT_VARS = rt_varlist_new();
-
-	rt_add_constant("#false", (Value){.type=V_INT, .int_value=0});
-	rt_add_constant("#true", (Value){.type=V_INT, .int_value=1});
-
-	RT_BUILTIN_FUNCTIONS = rt_fnlist_new();
-
-	rt_add_func("+", e_func_add, V_INT, 2, {V_INT, V_INT});
-	rt_add_func("-", e_func_sub, V_INT, 2, {V_INT, V_INT});
-	rt_add_func("*", e_func_mul, V_INT, 2, {V_INT, V_INT});
-	rt_add_func("%", e_func_mod, V_INT, 2, {V_INT, V_INT});
-	rt_add_func("=", e_func_eq, V_INT, 2, {V_INT, V_INT});
-	rt_add_func("!=", e_func_neq, V_INT, 2, {V_INT, V_INT});
-	rt_add_func(">", e_func_gt, V_INT, 2, {V_INT, V_INT});
-	rt_add_func("<=", e_func_le, V_INT, 2, {V_INT, V_INT});
-	rt_add_func("<", e_func_lt, V_INT, 2, {V_INT, V_INT});
-	rt_add_func(">=", e_func_ge, V_INT, 2, {V_INT, V_INT});
-	rt_add_func("bool", e_func_bool, V_INT, 1, {V_INT});
-	rt_add_func("fib", e_func_fib, V_INT, 1, {V_INT});
-	rt_add_func("list", e_func_list, V_LIST, RTFN_VARARGS, {});
-	rt_add_func("len", e_func_len, V_INT, 1, {V_LIST});
-	rt_add_func("sum", e_func_sum, V_INT, 1, {V_LIST});
-	rt_add_func("range", e_func_range, V_LIST, 2, {V_INT, V_INT});
-	rt_add_func("if", e_func_if, V_INT, 3, {V_INT, V_INT, V_INT});
+	#undef fmt_append
+	return len;
 }
@@ -0,0 +1,215 @@
+#ifndef LISP_H
+#define LISP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// embeddable interface to the lisp-like calculator in lisp.c
+//
+// all interpreter state lives in a lisp_ctx, so separate contexts can be
+// used from separate threads at the same time. a single context must only
+// be used by one thread at a time. errors never exit the process: the
+// failing call returns NULL/-1 and lisp_error() has the message
+
+// a value returned from the program
+typedef enum {
+	V_NONE,
+	V_INT,
+	V_LIST, // list of values
+	V_FUNC, // a builtin function passed by name, eg. the `sq` in (map sq l)
+	V_MAP // map from ints to ints
+} ValueType;
+
+struct Value;
+struct E_FuncData;
+
+// lists can share their values with other lists, so they must not be
+// written to. a list from load-ints is a view of a mapped file, not of
+// Values, so read elements with lisp_list_get() rather than values
+typedef struct {
+	struct Value* values;
+	int num_values;
+	int start; // where values is in the buffer it shares, < 0 if mapped
+} ValueList;
+
+// like lists, maps never change: a put makes a new version of the map
+// and the old one stays as it was. read them with lisp_map_get()
+typedef struct {
+	struct MapTable* table; // NULL for an empty map
+	int version; // how much of table it sees
+	int len; // number of keys
+} ValueMap;
+
+typedef struct Value {
+	ValueType type;
+	union {
+		int int_value;
+		ValueList list_value;
+		ValueMap map_value;
+		struct E_FuncData* func_value;
+	};
+} Value;
+
+typedef struct lisp_ctx lisp_ctx;
+
+// a compiled program, which can be evaluated any number of times
+typedef struct lisp_prog lisp_prog;
+
+lisp_ctx* lisp_ctx_new(void);
+void lisp_ctx_free(lisp_ctx* ctx);
+
+// split sum/len/min/max over inputs with at least par_threshold elements
+// across num_threads threads (the default is 1 thread). lisp_compile() also
+// tokenizes programs of a few MB and up on all of them
+void lisp_set_threads(lisp_ctx* ctx, int num_threads, int par_threshold);
+
+// false to always materialize intermediate lists in map/filter chains
+void lisp_set_fuse(lisp_ctx* ctx, bool fuse);
+
+// limits on each lisp_eval(), which fails once it goes over one of them.
+// 0 means no limit. a step is about one evaluated expression or one list
+// element produced, bytes are everything the evaluation has allocated and
+// still holds (mostly lists, but not the files load-ints maps), counted
+// across all threads of a parallel reduce. limits are checked every few
+// thousand steps, so an evaluation can go slightly over them before it is
+// stopped
+typedef struct {
+	long max_steps;
+	size_t max_bytes;
+	int max_ms;
+} lisp_budget;
+
+void lisp_set_budget(lisp_ctx* ctx, lisp_budget budget);
+
+// record the time taken by each builtin call, each closure call (under
+// its defun name, or "lambda"), each lisp_eval() and the
+// tokenize/make_ast/parse phases of lisp_compile() (prescan,
+// tokenize+make_ast and parse when it splits the program up), keeping the
+// last max_events of them. 0 turns tracing off and drops the recorded events
+void lisp_set_trace(lisp_ctx* ctx, int max_events);
+
+typedef enum {
+	LISP_TRACE_CHROME, // Trace Event Format JSON, for chrome://tracing or Perfetto
+	LISP_TRACE_FOLDED // folded stacks with self time in ns, for flamegraph.pl
+} lisp_trace_format;
+
+// write out the recorded events and start over
+void lisp_write_trace(lisp_ctx* ctx, FILE* f, lisp_trace_format format);
+
+// NULL on a syntax error. src does not need to stay alive afterwards
+lisp_prog* lisp_compile(lisp_ctx* ctx, const char* src, size_t len);
+void lisp_prog_free(lisp_prog* prog);
+
+// 0 on success, -1 on error. a list in *out stays valid until the next
+// lisp_eval() on the same context, which also unmaps the files load-ints
+// mapped. prog must come from the same context
+int lisp_eval(lisp_ctx* ctx, lisp_prog* prog, Value* out);
+
+// lisp_eval() with the inputs $0, $1, ... of the program bound to
+// params[0], params[1], ...
+int lisp_eval_params(lisp_ctx* ctx, lisp_prog* prog, const int* params, int num_params, Value* out);
+
+// evaluate prog once for each of num_rows rows, with $i bound to
+// cols[i][row], and store the results in out[row]. the result has to be
+// an int for every row. a program that is one expression of ints, $i, if
+// and arithmetic/comparison builtins is evaluated a block of rows at a
+// time with SIMD loops over the columns, anything else row by row. 0 on
+// success, -1 on error
+int lisp_eval_batch(lisp_ctx* ctx, lisp_prog* prog, const int* const* cols, int num_cols, int num_rows, int* out);
+
+// keep the results of up to max_entries programs taking up to max_bytes
+// for lisp_eval_source(). 0 for no limit, 0 in both turns the cache off.
+// only programs without $n and without builtins that read outside state
+// are cached, and only results made of ints and lists
+void lisp_set_cache(lisp_ctx* ctx, int max_entries, size_t max_bytes);
+
+typedef struct {
+	unsigned long source_hits; // same source as a cached program
+	unsigned long expr_hits; // compiles to the same Exprs as one
+	unsigned long misses;
+	unsigned long evictions;
+	int entries;
+	size_t bytes;
+} lisp_cache_stats;
+
+lisp_cache_stats lisp_get_cache_stats(lisp_ctx* ctx);
+
+// compile and evaluate src, or take its result from the cache. *out stays
+// valid until the next call on the same context, like with lisp_eval()
+int lisp_eval_source(lisp_ctx* ctx, const char* src, size_t len, Value* out);
+
+// write prog out as a standalone C file with int <name>_eval(params,
+// num_params, out) and int <name>_batch(cols, num_rows, out), which work
+// like lisp_eval_params() and lisp_eval_batch(), and with
+// -DLISP_AOT_MAIN a main() that takes $0, $1, ... as arguments. only
+// programs of ints, $n, if, let, define, top level defuns and int
+// builtins can be compiled. 0 on success, -1 on error
+int lisp_emit_c(lisp_ctx* ctx, lisp_prog* prog, const char* name, FILE* f);
+
+// native builtins. a builtin gets its call with the args unevaluated and
+// evaluates the ones it needs with lisp_arg() and friends, which fail the
+// evaluation on a wrong type. it is called straight from the evaluator,
+// like the builtins in lisp.c
+typedef struct Expr lisp_call;
+typedef Value lisp_builtin_fn(lisp_call* call);
+
+#define LISP_VARARGS (-1)
+
+typedef struct {
+	const char* name; // must not be taken, and must outlive the ctx
+	int num_args; // or LISP_VARARGS
+	const ValueType* arg_types; // num_args of them, NULL for LISP_VARARGS
+	ValueType return_type;
+	lisp_builtin_fn* fn;
+	bool impure; // depends on more than its args, so never cached
+} lisp_builtin;
+
+// add a builtin to ctx. only before anything is compiled on ctx, after
+// that it fails. 0 on success, -1 on error
+int lisp_add_builtin(lisp_ctx* ctx, const lisp_builtin* builtin);
+
+// only for a builtin, on its own call
+int lisp_num_args(lisp_call* call);
+Value lisp_arg(lisp_call* call, int i);
+int lisp_arg_int(lisp_call* call, int i);
+ValueList lisp_arg_list(lisp_call* call, int i);
+const char* lisp_arg_string(lisp_call* call, int i); // a "string literal"
+ValueList lisp_new_list(int num_values); // for the builtin to fill in
+void lisp_charge(long steps); // see lisp_budget
+_Noreturn void lisp_raise(const char* fmt, ...); // fails the evaluation
+
+// a plugin is a shared object defining
+//
+//	const int lisp_plugin_abi = LISP_PLUGIN_ABI;
+//	int lisp_plugin_init(lisp_ctx* ctx);
+//
+// where lisp_plugin_init() adds its builtins with lisp_add_builtin() and
+// returns 0, or -1 to fail the load. LISP_PLUGIN_ABI changes whenever
+// anything above does. the program loading one has to export these
+// functions to it, ie. link lisp.c into it with -rdynamic or use
+// liblisp.so
+#define LISP_PLUGIN_ABI 2
+
+// dlopen() path and run its lisp_plugin_init() on ctx. like
+// lisp_add_builtin(), only before anything is compiled. 0 on success, -1
+// on error
+int lisp_load_plugin(lisp_ctx* ctx, const char* path);
+
+// message for the last failed call on ctx
+const char* lisp_error(lisp_ctx* ctx);
+
+// element i of l. an int64 from load-ints64 that doesn't fit in an int
+// is cut to its low 32 bits, lisp_print_value() shows all of it
+Value lisp_list_get(ValueList l, int i);
+
+// the value of key in m, false if m doesn't have it
+bool lisp_map_get(ValueMap m, int key, int* out);
+
+void lisp_print_value(FILE* f, Value v);
+
+// like snprintf: writes at most size bytes including the '\0' and returns
+// the length the full text would have had
+int lisp_format_value(char* buf, size_t size, Value v);
+
+#endif
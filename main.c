@@ -0,0 +1,198 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "lisp.h"
+#include "server.h"
+
+// command line interface for lisp.c
+
+char* read_all(FILE* f, size_t* out_len) {
+	size_t len = 0, cap = 4096;
+	char* buf = malloc(cap);
+	size_t n;
+	while ((n = fread(buf + len, 1, cap - len, f)) > 0) {
+		len += n;
+		if (len == cap) {
+			cap *= 2;
+			buf = realloc(buf, cap);
+		}
+	}
+	*out_len = len;
+	return buf;
+}
+
+double now_seconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// usage: lisp [--no-fuse] [--stats] [--threads n] [--par-threshold n]
+//             [--trace file.json | --trace-folded file.folded]
+//             [--max-steps n] [--max-bytes n] [--max-ms n] [program]
+//        lisp --emit-c file.c [--aot-name name] [program]
+//        lisp --serve socket_path [--workers n] [--max-steps n] ...
+//             [--cache-entries n] [--cache-bytes n]
+// and --plugin lib.so, any number of times, in all of them
+// the limits apply to each evaluation, and to each request when serving.
+// the cache of results is per worker. plugins add builtins, see
+// lisp_load_plugin()
+// --emit-c writes the program out as C instead of running it, see
+// lisp_emit_c(). the program is read from stdin if not given
+int main(int argc, char** argv) {
+
+	lisp_ctx* ctx = lisp_ctx_new();
+
+	char* line = NULL;
+	size_t line_len = 0;
+	bool show_stats = false;
+	char* socket_path = NULL;
+	char* trace_path = NULL;
+	char* emit_path = NULL;
+	char* aot_name = "lisp_aot";
+	lisp_trace_format trace_format = LISP_TRACE_CHROME;
+	serve_config config = {0};
+
+	int num_workers = sysconf(_SC_NPROCESSORS_ONLN);
+	int num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	int par_threshold = 1 << 16;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--no-fuse")) {
+			lisp_set_fuse(ctx, false);
+		} else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+			num_threads = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "--par-threshold") && i + 1 < argc) {
+			par_threshold = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "--trace") && i + 1 < argc) {
+			trace_path = argv[++i];
+			trace_format = LISP_TRACE_CHROME;
+		} else if (!strcmp(argv[i], "--trace-folded") && i + 1 < argc) {
+			trace_path = argv[++i];
+			trace_format = LISP_TRACE_FOLDED;
+		} else if (!strcmp(argv[i], "--max-steps") && i + 1 < argc) {
+			config.budget.max_steps = atol(argv[++i]);
+		} else if (!strcmp(argv[i], "--max-bytes") && i + 1 < argc) {
+			config.budget.max_bytes = strtoull(argv[++i], NULL, 10);
+		} else if (!strcmp(argv[i], "--max-ms") && i + 1 < argc) {
+			config.budget.max_ms = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "--cache-entries") && i + 1 < argc) {
+			config.cache_entries = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "--cache-bytes") && i + 1 < argc) {
+			config.cache_bytes = strtoull(argv[++i], NULL, 10);
+		} else if (!strcmp(argv[i], "--emit-c") && i + 1 < argc) {
+			emit_path = argv[++i];
+		} else if (!strcmp(argv[i], "--aot-name") && i + 1 < argc) {
+			aot_name = argv[++i];
+		} else if (!strcmp(argv[i], "--plugin") && i + 1 < argc) {
+			config.plugins = realloc(config.plugins, sizeof(char*) * (config.num_plugins + 1));
+			config.plugins[config.num_plugins++] = argv[++i];
+		} else if (!strcmp(argv[i], "--stats")) {
+			show_stats = true;
+		} else if (!strcmp(argv[i], "--serve") && i + 1 < argc) {
+			socket_path = argv[++i];
+		} else if (!strcmp(argv[i], "--workers") && i + 1 < argc) {
+			num_workers = atoi(argv[++i]);
+		} else {
+			line = argv[i];
+			line_len = strlen(line);
+		}
+	}
+
+	lisp_set_threads(ctx, num_threads, par_threshold);
+	lisp_set_budget(ctx, config.budget);
+	if (trace_path != NULL) {
+		lisp_set_trace(ctx, 1 << 20);
+	}
+	for (int i = 0; i < config.num_plugins; i++) {
+		if (lisp_load_plugin(ctx, config.plugins[i]) != 0) {
+			fprintf(stderr, "%s\n", lisp_error(ctx));
+			lisp_ctx_free(ctx);
+			return 1;
+		}
+	}
+
+	if (socket_path != NULL) {
+		lisp_ctx_free(ctx);
+		if (num_workers < 1) {
+			fprintf(stderr, "--workers: need at least 1\n");
+			return 1;
+		}
+		return serve(socket_path, num_workers, 5, config);
+	}
+
+	if (line == NULL) {
+		line = read_all(stdin, &line_len);
+	}
+
+	if (emit_path != NULL) {
+		lisp_prog* prog = lisp_compile(ctx, line, line_len);
+		FILE* f = prog != NULL ? fopen(emit_path, "w") : NULL;
+		if (prog != NULL && f == NULL) {
+			perror(emit_path);
+			return 1;
+		}
+		int status = prog != NULL ? lisp_emit_c(ctx, prog, aot_name, f) : -1;
+		if (f != NULL) {
+			fclose(f);
+		}
+		if (status != 0) {
+			fprintf(stderr, "%s\n", lisp_error(ctx));
+			remove(emit_path);
+		}
+		if (prog != NULL) {
+			lisp_prog_free(prog);
+		}
+		lisp_ctx_free(ctx);
+		return status != 0;
+	}
+
+	double start = now_seconds();
+
+	Value result;
+	lisp_prog* prog = lisp_compile(ctx, line, line_len);
+	bool ok = prog != NULL && lisp_eval(ctx, prog, &result) == 0;
+
+	double elapsed = now_seconds() - start;
+
+	// also written when the program fails, to see how far it got
+	if (trace_path != NULL) {
+		FILE* f = fopen(trace_path, "w");
+		if (f == NULL) {
+			perror(trace_path);
+		} else {
+			lisp_write_trace(ctx, f, trace_format);
+			fclose(f);
+		}
+	}
+
+	if (!ok) {
+		fprintf(stderr, "%s\n", lisp_error(ctx));
+		if (prog != NULL) {
+			lisp_prog_free(prog);
+		}
+		lisp_ctx_free(ctx);
+		return 1;
+	}
+
+	lisp_print_value(stdout, result);
+	putc('\n', stdout);
+
+	if (show_stats) {
+		struct rusage ru;
+		getrusage(RUSAGE_SELF, &ru);
+		fprintf(stderr, "time: %.3f ms, max rss: %ld KB\n",
+			elapsed * 1e3,
+			ru.ru_maxrss);
+	}
+
+	lisp_prog_free(prog);
+	lisp_ctx_free(ctx);
+
+	return 0;
+}
@@ -0,0 +1,94 @@
+#include "lisp.h"
+
+// sample plugin, see lisp_load_plugin(): a few int kernels that are slow
+// to write in the language itself
+//
+//	(gcd a b) - greatest common divisor, 0 if both are 0
+//	(isqrt n) - floor of the square root of n >= 0
+//	(popcount n) - set bits in n as an unsigned int
+//	(dot a b) - sum of a[i] * b[i] over two lists of the same length
+//	(square n) - n * n, the same as sq, to compare calls against
+//
+// build: gcc -std=gnu11 -O2 -fPIC -shared -I. plugins/intmath.c -o plugins/libintmath.so
+// use:   ./lisp --plugin plugins/libintmath.so "(gcd 84 36)"
+
+const int lisp_plugin_abi = LISP_PLUGIN_ABI;
+
+static Value int_value(int n) {
+	return (Value){.type = V_INT, .int_value = n};
+}
+
+static Value gcd(lisp_call* call) {
+	unsigned a = lisp_arg_int(call, 0);
+	unsigned b = lisp_arg_int(call, 1);
+	a = (int)a < 0 ? -a : a;
+	b = (int)b < 0 ? -b : b;
+	while (b != 0) {
+		unsigned t = a % b;
+		a = b;
+		b = t;
+	}
+	return int_value(a);
+}
+
+static Value isqrt(lisp_call* call) {
+	int n = lisp_arg_int(call, 0);
+	if (n < 0) {
+		lisp_raise("isqrt: %d is negative", n);
+	}
+	// Newton's method from above, on unsigned so x + n / x can't overflow
+	unsigned x = n, y = (x + 1) / 2;
+	while (y < x) {
+		x = y;
+		y = (x + n / x) / 2;
+	}
+	return int_value(x);
+}
+
+static Value popcount(lisp_call* call) {
+	return int_value(__builtin_popcount((unsigned)lisp_arg_int(call, 0)));
+}
+
+static Value dot(lisp_call* call) {
+	ValueList a = lisp_arg_list(call, 0);
+	ValueList b = lisp_arg_list(call, 1);
+	if (a.num_values != b.num_values) {
+		lisp_raise("dot: lists of %d and %d", a.num_values, b.num_values);
+	}
+	lisp_charge(a.num_values);
+	unsigned sum = 0;
+	for (int i = 0; i < a.num_values; i++) {
+		Value x = lisp_list_get(a, i);
+		Value y = lisp_list_get(b, i);
+		if (x.type != V_INT || y.type != V_INT) {
+			lisp_raise("dot: arguments should be lists of int");
+		}
+		sum += (unsigned)x.int_value * (unsigned)y.int_value;
+	}
+	return int_value(sum);
+}
+
+static Value square(lisp_call* call) {
+	unsigned n = lisp_arg_int(call, 0);
+	return int_value(n * n);
+}
+
+int lisp_plugin_init(lisp_ctx* ctx) {
+	static const ValueType one_int[] = {V_INT};
+	static const ValueType two_ints[] = {V_INT, V_INT};
+	static const ValueType two_lists[] = {V_LIST, V_LIST};
+
+	static const lisp_builtin builtins[] = {
+		{"gcd", 2, two_ints, V_INT, gcd, .impure = false},
+		{"isqrt", 1, one_int, V_INT, isqrt, .impure = false},
+		{"popcount", 1, one_int, V_INT, popcount, .impure = false},
+		{"dot", 2, two_lists, V_INT, dot, .impure = false},
+		{"square", 1, one_int, V_INT, square, .impure = false},
+	};
+	for (size_t i = 0; i < sizeof(builtins) / sizeof(builtins[0]); i++) {
+		if (lisp_add_builtin(ctx, &builtins[i]) != 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,382 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "lisp.h"
+#include "server.h"
+
+/*	each worker thread owns an epoll instance, a lisp_ctx and the clients
+	that the accepting thread handed to it. a worker reads everything a
+	client has sent, evaluates every complete line in order and then
+	flushes all of the responses with a single write, so pipelined
+	requests from one client are answered in order without any locking */
+
+// longest request line, a client sending more without a newline is
+// answered with an error and closed
+#define MAX_LINE (1 << 20)
+
+// latency histogram: 16 linear sub-buckets per power of two of nanoseconds
+#define HIST_BUCKETS (64 * 16)
+
+typedef struct {
+	atomic_ulong counts[HIST_BUCKETS];
+} Histogram;
+
+int hist_bucket(uint64_t ns) {
+	if (ns < 16) {
+		return ns;
+	}
+	int exp = 63 - __builtin_clzll(ns);
+	int sub = (ns >> (exp - 4)) & 15;
+	return (exp - 3) * 16 + sub;
+}
+
+// smallest latency that falls into bucket i
+uint64_t hist_bucket_ns(int i) {
+	if (i < 16) {
+		return i;
+	}
+	int exp = i / 16 + 3;
+	int sub = i % 16;
+	return (uint64_t)(16 + sub) << (exp - 4);
+}
+
+typedef struct {
+	char* data;
+	size_t len;
+	size_t cap;
+} Buf;
+
+void buf_reserve(Buf* b, size_t extra) {
+	if (b->len + extra <= b->cap) {
+		return;
+	}
+	while (b->len + extra > b->cap) {
+		b->cap = b->cap ? b->cap * 2 : 4096;
+	}
+	b->data = realloc(b->data, b->cap);
+}
+
+// drop the first n bytes
+void buf_consume(Buf* b, size_t n) {
+	memmove(b->data, b->data + n, b->len - n);
+	b->len -= n;
+}
+
+typedef struct {
+	int fd;
+	Buf in;
+	Buf out;
+	bool closing; // the client hung up, close once out is flushed
+} Client;
+
+typedef struct {
+	pthread_t thread;
+	int epoll_fd;
+	lisp_ctx* ctx;
+	Histogram latency;
+	atomic_ulong num_requests;
+	atomic_ulong num_errors;
+	atomic_ulong num_cache_hits; // copied from the ctx after each request
+} Worker;
+
+uint64_t now_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void client_close(Worker* w, Client* c) {
+	epoll_ctl(w->epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+	close(c->fd);
+	free(c->in.data);
+	free(c->out.data);
+	free(c);
+}
+
+// evaluate one request line and append its response line to c->out
+void client_eval_line(Worker* w, Client* c, char* line, size_t len) {
+	uint64_t start = now_ns();
+
+	Value v;
+	bool ok = lisp_eval_source(w->ctx, line, len, &v) == 0;
+
+	if (ok) {
+		int n = lisp_format_value(NULL, 0, v);
+		buf_reserve(&c->out, n + 2);
+		lisp_format_value(c->out.data + c->out.len, n + 1, v);
+		c->out.len += n;
+	} else {
+		const char* err = lisp_error(w->ctx);
+		size_t n = strlen(err);
+		buf_reserve(&c->out, n + 1);
+		memcpy(c->out.data + c->out.len, err, n);
+		c->out.len += n;
+		atomic_fetch_add_explicit(&w->num_errors, 1, memory_order_relaxed);
+	}
+	c->out.data[c->out.len++] = '\n';
+
+	int bucket = hist_bucket(now_ns() - start);
+	atomic_fetch_add_explicit(&w->latency.counts[bucket], 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&w->num_requests, 1, memory_order_relaxed);
+
+	lisp_cache_stats cs = lisp_get_cache_stats(w->ctx);
+	atomic_store_explicit(&w->num_cache_hits, cs.source_hits + cs.expr_hits, memory_order_relaxed);
+}
+
+// write as much of c->out as the socket takes. false if the client is gone
+bool client_flush(Worker* w, Client* c) {
+	size_t sent = 0;
+	while (sent < c->out.len) {
+		ssize_t n = write(c->fd, c->out.data + sent, c->out.len - sent);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno == EAGAIN) {
+				break;
+			}
+			return false;
+		}
+		sent += n;
+	}
+	buf_consume(&c->out, sent);
+
+	// only wait for writability while there is something left to send
+	struct epoll_event ev = {
+		.events = EPOLLIN | EPOLLRDHUP | (c->out.len ? EPOLLOUT : 0),
+		.data.ptr = c
+	};
+	epoll_ctl(w->epoll_fd, EPOLL_CTL_MOD, c->fd, &ev);
+	return true;
+}
+
+// false if the client should be closed
+bool client_on_readable(Worker* w, Client* c) {
+	// epoll is level triggered, so what is left unread comes back later
+	while (c->in.len <= MAX_LINE) {
+		buf_reserve(&c->in, 4096);
+		ssize_t n = read(c->fd, c->in.data + c->in.len, c->in.cap - c->in.len);
+		if (n > 0) {
+			c->in.len += n;
+			continue;
+		}
+		if (n == 0) {
+			c->closing = true;
+			break;
+		}
+		if (errno == EINTR) {
+			continue;
+		}
+		if (errno == EAGAIN) {
+			break;
+		}
+		return false;
+	}
+
+	size_t start = 0;
+	for (size_t i = 0; i < c->in.len; i++) {
+		if (c->in.data[i] == '\n') {
+			if (i > start) {
+				client_eval_line(w, c, c->in.data + start, i - start);
+			}
+			start = i + 1;
+		}
+	}
+	buf_consume(&c->in, start);
+
+	if (c->in.len > MAX_LINE) {
+		static const char err[] = "serve: request line too long\n";
+		buf_reserve(&c->out, sizeof(err) - 1);
+		memcpy(c->out.data + c->out.len, err, sizeof(err) - 1);
+		c->out.len += sizeof(err) - 1;
+		atomic_fetch_add_explicit(&w->num_errors, 1, memory_order_relaxed);
+		client_flush(w, c);
+		return false;
+	}
+
+	if (!client_flush(w, c)) {
+		return false;
+	}
+	return !(c->closing && c->out.len == 0);
+}
+
+void* worker_main(void* arg) {
+	Worker* w = arg;
+	struct epoll_event events[64];
+
+	for (;;) {
+		int n = epoll_wait(w->epoll_fd, events, 64, -1);
+		for (int i = 0; i < n; i++) {
+			Client* c = events[i].data.ptr;
+			bool keep = true;
+
+			if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) {
+				keep = client_on_readable(w, c);
+			} else if (events[i].events & EPOLLOUT) {
+				keep = client_flush(w, c) && !(c->closing && c->out.len == 0);
+			}
+			if (events[i].events & EPOLLERR) {
+				keep = false;
+			}
+
+			if (!keep) {
+				client_close(w, c);
+			}
+		}
+	}
+	return NULL;
+}
+
+// print the request rate and latency percentiles since the last report
+void report_stats(Worker* workers, int num_workers, double seconds) {
+	static uint64_t last_counts[HIST_BUCKETS];
+	static uint64_t last_requests;
+	static uint64_t last_errors;
+	static uint64_t last_hits;
+
+	uint64_t counts[HIST_BUCKETS] = {0};
+	uint64_t requests = 0, errors = 0, hits = 0;
+
+	for (int i = 0; i < num_workers; i++) {
+		requests += atomic_load(&workers[i].num_requests);
+		errors += atomic_load(&workers[i].num_errors);
+		hits += atomic_load(&workers[i].num_cache_hits);
+		for (int j = 0; j < HIST_BUCKETS; j++) {
+			counts[j] += atomic_load_explicit(
+				&workers[i].latency.counts[j],
+				memory_order_relaxed);
+		}
+	}
+
+	uint64_t total = requests - last_requests;
+	if (total > 0) {
+		uint64_t p50 = 0, p99 = 0, seen = 0;
+		for (int j = 0; j < HIST_BUCKETS; j++) {
+			seen += counts[j] - last_counts[j];
+			if (p50 == 0 && seen * 2 >= total) {
+				p50 = hist_bucket_ns(j);
+			}
+			if (seen * 100 >= total * 99) {
+				p99 = hist_bucket_ns(j);
+				break;
+			}
+		}
+
+		fprintf(stderr,
+			"serve: %.0f req/s, p50 %.1f us, p99 %.1f us, %lu errors, %.1f%% cached\n",
+			total / seconds,
+			p50 / 1e3,
+			p99 / 1e3,
+			errors - last_errors,
+			100.0 * (hits - last_hits) / total);
+	}
+
+	memcpy(last_counts, counts, sizeof(counts));
+	last_requests = requests;
+	last_errors = errors;
+	last_hits = hits;
+}
+
+int serve(const char* socket_path, int num_workers, int stats_interval, serve_config config) {
+
+	if (num_workers < 1) {
+		fprintf(stderr, "serve: need at least 1 worker\n");
+		return 1;
+	}
+
+	// a client hanging up mid-write must not kill the server
+	signal(SIGPIPE, SIG_IGN);
+
+	int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	struct sockaddr_un addr = {.sun_family = AF_UNIX};
+	if (listen_fd < 0 || strlen(socket_path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "serve: bad socket path %s\n", socket_path);
+		return 1;
+	}
+	strcpy(addr.sun_path, socket_path);
+	unlink(socket_path);
+
+	if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0
+	|| listen(listen_fd, 512) < 0) {
+		fprintf(stderr, "serve: %s: %s\n", socket_path, strerror(errno));
+		return 1;
+	}
+
+	// every worker is set up before any of them runs, so that a plugin
+	// that fails to load leaves no threads behind
+	Worker* workers = calloc(num_workers, sizeof(Worker));
+	for (int i = 0; i < num_workers; i++) {
+		workers[i].epoll_fd = epoll_create1(0);
+		workers[i].ctx = lisp_ctx_new();
+		lisp_set_budget(workers[i].ctx, config.budget);
+		lisp_set_cache(workers[i].ctx, config.cache_entries, config.cache_bytes);
+		for (int j = 0; j < config.num_plugins; j++) {
+			if (lisp_load_plugin(workers[i].ctx, config.plugins[j]) != 0) {
+				fprintf(stderr, "serve: %s\n", lisp_error(workers[i].ctx));
+				for (int k = 0; k <= i; k++) {
+					close(workers[k].epoll_fd);
+					lisp_ctx_free(workers[k].ctx);
+				}
+				free(workers);
+				close(listen_fd);
+				unlink(socket_path);
+				return 1;
+			}
+		}
+	}
+	for (int i = 0; i < num_workers; i++) {
+		pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]);
+	}
+
+	fprintf(stderr, "serve: listening on %s with %d workers\n",
+		socket_path,
+		num_workers);
+
+	uint64_t last_report = now_ns();
+	int next_worker = 0;
+
+	for (;;) {
+		struct pollfd pfd = {.fd = listen_fd, .events = POLLIN};
+		int ready = poll(&pfd, 1, 1000);
+
+		if (ready > 0) {
+			int fd = accept(listen_fd, NULL, NULL);
+			if (fd >= 0) {
+				fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+				Client* c = calloc(1, sizeof(Client));
+				c->fd = fd;
+
+				// hand the client to the next worker, which owns it from now on
+				Worker* w = &workers[next_worker];
+				next_worker = (next_worker + 1) % num_workers;
+
+				struct epoll_event ev = {
+					.events = EPOLLIN | EPOLLRDHUP,
+					.data.ptr = c
+				};
+				epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+			}
+		}
+
+		uint64_t now = now_ns();
+		if (stats_interval > 0 && now - last_report >= (uint64_t)stats_interval * 1000000000) {
+			report_stats(workers, num_workers, (now - last_report) / 1e9);
+			last_report = now;
+		}
+	}
+}
@@ -0,0 +1,24 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "lisp.h"
+
+// applied to the lisp_ctx of every worker
+typedef struct {
+	lisp_budget budget; // for every request
+	int cache_entries; // see lisp_set_cache(), per worker
+	size_t cache_bytes;
+	const char** plugins; // loaded into every worker, see lisp_load_plugin()
+	int num_plugins;
+} serve_config;
+
+// evaluation daemon: listens on a unix socket, reads one expression per
+// line from each client and writes back one result (or error) per line,
+// in order. expressions are evaluated on num_workers threads, each with
+// its own lisp_ctx. a line longer than 1 MB gets an error and the client
+// is closed. latency and request rate are reported on stderr every
+// stats_interval seconds. only returns if num_workers < 1, the socket
+// can't be set up or a plugin can't be loaded
+int serve(const char* socket_path, int num_workers, int stats_interval, serve_config config);
+
+#endif
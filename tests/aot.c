@@ -0,0 +1,194 @@
+#include <dlfcn.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "lisp.h"
+
+// random programs of ints, let, define and if compiled to C with
+// lisp_emit_c() and run on random inputs against the interpreter. every
+// result has to be the same, and so does whether it fails, which some do
+// with % by 0. all programs go into one C file, built with $CC (or cc)
+// as a shared object and loaded with dlopen()
+//
+// usage: aot [programs] [rows]
+
+typedef int EvalFn(const int* params, int num_params, int* out);
+
+unsigned next_rand(unsigned* seed) {
+	*seed = *seed * 1103515245 + 12345;
+	return *seed >> 16;
+}
+
+// a random int expression over $0..$2 and the num_vars variables in scope
+void gen_expr(char** p, int depth, int num_vars, unsigned* seed) {
+	static const char* binary[] = {"+", "-", "*", "=", "!=", "<", ">", "<=", ">="};
+	static const char* unary[] = {"bool", "sq", "odd", "even"};
+
+	unsigned k = next_rand(seed) % (depth > 0 ? 10 : 3);
+	if (k == 0) {
+		*p += sprintf(*p, "%d", (int)(next_rand(seed) % 2001) - 1000);
+	} else if (k == 1) {
+		*p += sprintf(*p, "$%u", next_rand(seed) % 3);
+	} else if (k == 2) {
+		if (num_vars > 0) {
+			*p += sprintf(*p, "x%u", next_rand(seed) % num_vars);
+		} else {
+			*p += sprintf(*p, "#true");
+		}
+	} else if (k <= 5) {
+		*p += sprintf(*p, "(%s ", binary[next_rand(seed) % 9]);
+		gen_expr(p, depth - 1, num_vars, seed);
+		*(*p)++ = ' ';
+		gen_expr(p, depth - 1, num_vars, seed);
+		*(*p)++ = ')';
+	} else if (k == 6) {
+		*p += sprintf(*p, "(%s ", unary[next_rand(seed) % 4]);
+		gen_expr(p, depth - 1, num_vars, seed);
+		*(*p)++ = ')';
+	} else if (k == 7) {
+		// now and then by 0, which fails, or by -1, which C traps on for INT_MIN
+		unsigned d = next_rand(seed) % 20;
+		*p += sprintf(*p, "(%% ");
+		gen_expr(p, depth - 1, num_vars, seed);
+		*p += sprintf(*p, " %d)", d == 0 ? 0 : d == 1 ? -1 : (int)(d % 9) + 1);
+	} else if (k == 8) {
+		*p += sprintf(*p, "(if ");
+		for (int i = 0; i < 3; i++) {
+			gen_expr(p, depth - 1, num_vars, seed);
+			*(*p)++ = i < 2 ? ' ' : ')';
+		}
+	} else {
+		// a let that also defines a name in its body
+		*p += sprintf(*p, "(let ((x%d ", num_vars);
+		gen_expr(p, depth - 1, num_vars, seed);
+		*p += sprintf(*p, ")) (define x%d ", num_vars + 1);
+		gen_expr(p, depth - 1, num_vars + 1, seed);
+		*p += sprintf(*p, ") ");
+		gen_expr(p, depth - 1, num_vars + 2, seed);
+		*(*p)++ = ')';
+	}
+	**p = '\0';
+}
+
+lisp_prog* compile(lisp_ctx* ctx, const char* src) {
+	lisp_prog* prog = lisp_compile(ctx, src, strlen(src));
+	if (prog == NULL) {
+		fprintf(stderr, "%s: %s\n", src, lisp_error(ctx));
+		exit(1);
+	}
+	return prog;
+}
+
+void emit(lisp_ctx* ctx, const char* src, const char* name, FILE* f) {
+	lisp_prog* prog = compile(ctx, src);
+	if (lisp_emit_c(ctx, prog, name, f) != 0) {
+		fprintf(stderr, "%s: %s\n", src, lisp_error(ctx));
+		exit(1);
+	}
+	lisp_prog_free(prog);
+}
+
+int main(int argc, char** argv) {
+	int num_random = argc > 1 ? atoi(argv[1]) : 300;
+	int num_rows = argc > 2 ? atoi(argv[2]) : 1000;
+
+	int* cols[3];
+	unsigned seed = 1;
+	for (int i = 0; i < 3; i++) {
+		cols[i] = malloc(sizeof(int) * num_rows);
+	}
+	for (int r = 0; r < num_rows; r++) {
+		for (int i = 0; i < 3; i++) {
+			cols[i][r] = (int)(next_rand(&seed) % 2001) - 1000;
+		}
+	}
+
+	char** random = malloc(sizeof(char*) * num_random);
+	for (int i = 0; i < num_random; i++) {
+		random[i] = malloc(1 << 16);
+		char* p = random[i];
+		gen_expr(&p, 6, 0, &seed);
+	}
+
+	// everything into one file, built once
+	char c_path[64], so_path[64], cmd[256];
+	snprintf(c_path, sizeof(c_path), "/tmp/lisp-aot-test-%d.c", (int)getpid());
+	snprintf(so_path, sizeof(so_path), "/tmp/lisp-aot-test-%d.so", (int)getpid());
+
+	lisp_ctx* ctx = lisp_ctx_new();
+	FILE* f = fopen(c_path, "w");
+	for (int i = 0; i < num_random; i++) {
+		char name[32];
+		snprintf(name, sizeof(name), "random%d", i);
+		emit(ctx, random[i], name, f);
+	}
+	fclose(f);
+
+	const char* cc = getenv("CC") != NULL ? getenv("CC") : "cc";
+	snprintf(cmd, sizeof(cmd), "%s -std=gnu11 -O3 -fwrapv -fPIC -shared %s -o %s", cc, c_path, so_path);
+	if (system(cmd) != 0) {
+		fprintf(stderr, "%s failed\n", cmd);
+		return 1;
+	}
+	void* lib = dlopen(so_path, RTLD_NOW);
+	if (lib == NULL) {
+		fprintf(stderr, "%s\n", dlerror());
+		return 1;
+	}
+	remove(c_path);
+	remove(so_path);
+
+	int failures = 0, num_failed = 0;
+	for (int i = 0; i < num_random; i++) {
+		char sym[32];
+		snprintf(sym, sizeof(sym), "random%d_eval", i);
+		EvalFn* fn = dlsym(lib, sym);
+		if (fn == NULL) {
+			fprintf(stderr, "%s\n", dlerror());
+			return 1;
+		}
+
+		lisp_prog* prog = compile(ctx, random[i]);
+		for (int r = 0; r < num_rows; r++) {
+			int params[3] = {cols[0][r], cols[1][r], cols[2][r]};
+			Value v;
+			int native_out;
+			bool failed = lisp_eval_params(ctx, prog, params, 3, &v) != 0;
+			if (failed != (fn(params, 3, &native_out) != 0)) {
+				printf("FAIL %s with $0..$2 = %d %d %d: %s in the interpreter, %s compiled\n",
+					random[i], params[0], params[1], params[2],
+					failed ? lisp_error(ctx) : "no error",
+					failed ? "no error" : "an error");
+				failures++;
+				break;
+			}
+			if (failed) {
+				num_failed++;
+			} else if (native_out != v.int_value) {
+				printf("FAIL %s with $0..$2 = %d %d %d: %d, expected %d\n",
+					random[i], params[0], params[1], params[2], native_out, v.int_value);
+				failures++;
+				break;
+			}
+		}
+		lisp_prog_free(prog);
+	}
+
+	dlclose(lib);
+	lisp_ctx_free(ctx);
+	for (int i = 0; i < 3; i++) {
+		free(cols[i]);
+	}
+	for (int i = 0; i < num_random; i++) {
+		free(random[i]);
+	}
+	free(random);
+
+	if (failures == 0) {
+		printf("ok, %d random programs on %d rows, %d failed both ways\n",
+			num_random, num_rows, num_failed);
+	}
+	return failures != 0;
+}
@@ -0,0 +1,133 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "lisp.h"
+
+// programs that have to come back from lisp_eval_source() with an error,
+// or with a result, instead of taking the process down with them. each
+// one runs on a fresh context
+//
+// usage: errors
+
+int failures;
+
+void expect_error(const char* src, const char* error) {
+	lisp_ctx* ctx = lisp_ctx_new();
+	Value v;
+	if (lisp_eval_source(ctx, src, strlen(src), &v) == 0) {
+		printf("FAIL %s: no error\n", src);
+		failures++;
+	} else if (strstr(lisp_error(ctx), error) == NULL) {
+		printf("FAIL %s: %s, expected %s\n", src, lisp_error(ctx), error);
+		failures++;
+	}
+	lisp_ctx_free(ctx);
+}
+
+// the same error from a budget whether or not the reduce is split
+void expect_error_threads(const char* src, const char* error, lisp_budget budget) {
+	for (int num_threads = 1; num_threads <= 4; num_threads += 3) {
+		lisp_ctx* ctx = lisp_ctx_new();
+		lisp_set_threads(ctx, num_threads, 10);
+		lisp_set_budget(ctx, budget);
+		Value v;
+		if (lisp_eval_source(ctx, src, strlen(src), &v) == 0) {
+			printf("FAIL %s on %d threads: no error\n", src, num_threads);
+			failures++;
+		} else if (strstr(lisp_error(ctx), error) == NULL) {
+			printf("FAIL %s on %d threads: %s, expected %s\n", src, num_threads, lisp_error(ctx), error);
+			failures++;
+		}
+		lisp_ctx_free(ctx);
+	}
+}
+
+void expect_int_budget(const char* src, int expected, lisp_budget budget) {
+	lisp_ctx* ctx = lisp_ctx_new();
+	lisp_set_budget(ctx, budget);
+	Value v;
+	if (lisp_eval_source(ctx, src, strlen(src), &v) != 0) {
+		printf("FAIL %s: %s\n", src, lisp_error(ctx));
+		failures++;
+	} else if (v.type != V_INT || v.int_value != expected) {
+		printf("FAIL %s: %d, expected %d\n", src, v.int_value, expected);
+		failures++;
+	}
+	lisp_ctx_free(ctx);
+}
+
+void expect_int(const char* src, int expected) {
+	expect_int_budget(src, expected, (lisp_budget){0});
+}
+
+Value one(lisp_call* call) {
+	(void)call; // takes no args
+	return (Value){.type = V_INT, .int_value = 1};
+}
+
+int main() {
+	// % would trap in C
+	expect_error("(% 1 0)", "%: division by zero");
+	expect_error("(% 0 0)", "%: division by zero");
+	expect_error("(sum (map (lambda (x) (% 7 x)) (range -3 3)))", "%: division by zero");
+	expect_int("(% (- (- 0 2147483647) 1) -1)", 0);
+	expect_int("(% 7 -1)", 0);
+	expect_int("(% -7 2)", -1);
+
+	// fib is 1 below 2, also for a negative n
+	expect_int("(fib -1)", 1);
+	expect_int("(fib (- 0 2147483647))", 1);
+	expect_int_budget("(fib -1)", 1, (lisp_budget){.max_steps = 1000});
+	expect_int_budget("(fib -100)", 1, (lisp_budget){.max_steps = 100});
+
+	// chunks of a parallel reduce share the caller's budget
+	expect_error_threads("(sum (map (lambda (x) (nth 0 (push x (range 0 100000)))) (range 0 200)))",
+		"memory budget exceeded", (lisp_budget){.max_bytes = 1000000});
+	expect_error_threads("(sum (map (lambda (x) (sum (range 0 x))) (range 0 100000)))",
+		"step budget exceeded", (lisp_budget){.max_steps = 100000});
+	expect_error_threads("(sum (map (lambda (x) (% 7 (- x 150))) (range 0 200)))",
+		"%: division by zero", (lisp_budget){0});
+
+	// a sum wraps around the same way however it is split up
+	for (int num_threads = 1; num_threads <= 4; num_threads += 3) {
+		lisp_ctx* ctx = lisp_ctx_new();
+		lisp_set_threads(ctx, num_threads, 10);
+		const char* src = "(sum (map (lambda (x) 2147483647) (range 0 1000)))";
+		Value v;
+		if (lisp_eval_source(ctx, src, strlen(src), &v) != 0 || v.int_value != -1000) {
+			printf("FAIL %s on %d threads: %d, expected -1000\n", src, num_threads, v.int_value);
+			failures++;
+		}
+		lisp_ctx_free(ctx);
+	}
+
+	// the column version leaves a zero divisor to the builtin
+	lisp_ctx* ctx = lisp_ctx_new();
+	lisp_prog* prog = lisp_compile(ctx, "(% $0 $1)", 9);
+	int xs[] = {7, 7, 7, -2147483647 - 1}, ys[] = {2, -1, 0, -1}, out[4];
+	const int* cols[] = {xs, ys};
+	if (lisp_eval_batch(ctx, prog, cols, 2, 4, out) == 0) {
+		printf("FAIL (%% $0 $1) batch: no error\n");
+		failures++;
+	}
+	ys[2] = 3;
+	if (lisp_eval_batch(ctx, prog, cols, 2, 4, out) != 0 || out[1] != 0 || out[3] != 0) {
+		printf("FAIL (%% $0 $1) batch: %s\n", lisp_error(ctx));
+		failures++;
+	}
+	lisp_prog_free(prog);
+
+	// programs already compiled index the builtins there are
+	lisp_builtin b = {.name = "one", .arg_types = (ValueType[]){V_NONE}, .return_type = V_INT, .fn = one};
+	if (lisp_add_builtin(ctx, &b) == 0) {
+		printf("FAIL lisp_add_builtin() after lisp_compile(): no error\n");
+		failures++;
+	}
+	lisp_ctx_free(ctx);
+
+	if (failures == 0) {
+		printf("ok\n");
+	}
+	return failures != 0;
+}